@@ -1,26 +1,63 @@
 #include <stdio.h>
 #include <math.h> 
+#include <vector>
 #include "gpu-sim.h"
 #include "gpu-misc.h"
 
 #define MAX_INT 1<<30
 
+// Pisacha: latency stage bookkeeping for requests handed around by HIST.
+//          A request falling back to L2 re-enters its L1 miss queue stage.
+static void hist_stage( mem_fetch *mf, unsigned stage )
+{
+    mf_stage( mf, stage, gpu_sim_cycle + gpu_tot_sim_cycle );
+}
+
 HIST_table::HIST_table( unsigned set, unsigned assoc, unsigned range, unsigned delay, unsigned age, unsigned n_sm, cache_config &config, gpgpu_sim *gpu ): 
                         m_hist_nset(set), m_hist_assoc(assoc), m_hist_range(range), m_hist_delay(delay), m_hist_age(age), n_total_sm(n_sm),
                         m_line_sz(config.get_line_sz()), m_line_sz_log2(LOGB2(config.get_line_sz())),
+                        m_hist_page_sz(gpu->get_config().gpu_hist_page_sz),
+                        m_hist_atomic(gpu->get_config().gpu_hist_atomic),
+                        m_hist_atomic_lat(gpu->get_config().gpu_hist_atomic_lat),
+                        m_hist_evict_notify(gpu->get_config().gpu_hist_evict_notify),
+                        m_hist_evict_batch(gpu->get_config().gpu_hist_evict_batch),
+                        m_hist_retry_size(gpu->get_config().gpu_hist_retry_size),
+                        m_hist_retry_wait(gpu->get_config().gpu_hist_retry_wait),
+                        m_hist_coalesce(gpu->get_config().gpu_hist_coalesce),
+                        m_flit_size(gpu->getMemoryConfig()->icnt_flit_size),
+                        m_hist_boundary(gpu->get_config().gpu_hist_boundary),
+                        m_hist_boundary_age(gpu->get_config().gpu_hist_boundary_age),
                         m_cache_config(config), m_gpu(gpu)
 {
+    assert( set > 0 && assoc > 0 );     // Pisacha: get_set_idx takes key % m_hist_nset
     recv_mf = new std::list<mem_fetch*>[n_sm];
     srcn_mf = new std::list<mem_fetch*>[n_sm];
+    inv_msg = new std::list<hist_msg_t>[n_sm];
+    evict_buf = new std::list<hist_msg_t>[n_sm];
+    evict_msg = new std::list<hist_msg_t>[n_sm];
+    nack_mf = new std::list<mem_fetch*>[n_sm];
+    retry_mf = new std::list<hist_retry_t>[n_sm];
+    atom_mf = new std::list<mem_fetch*>[n_sm];
     
+    m_flush_time = new unsigned[n_sm]();
     m_hist_table = new hist_entry_t*[n_sm];
     for( unsigned i=0; i<n_sm; i++ ){
         m_hist_table[i] = new hist_entry_t[set*assoc];
         for( unsigned j=0; j<set*assoc; j++ ){
             m_hist_table[i][j].filtered_mf = new std::list<mem_fetch*>[n_sm];
+            m_hist_table[i][j].m_add_time  = new unsigned[n_sm]();
         }
     }
 
+    for( unsigned i=0; i<N_HIST_MSG_TYPE; i++ ){
+        m_msg_count[i]     = 0;
+        m_msg_flits[i]     = 0;
+        m_msg_flit_hops[i] = 0;
+    }
+
+    m_epoch      = 0;
+    m_epoch_keep = ( m_hist_boundary == HIST_BOUNDARY_AGE )? m_hist_boundary_age : 0;
+
     n_sm_sqrt = sqrt(n_sm);
     if( n_sm_sqrt*n_sm_sqrt < n_sm ){
         n_sm_sqrt++;
@@ -28,6 +65,28 @@ HIST_table::HIST_table( unsigned set, unsigned assoc, unsigned range, unsigned d
     print_config();
 }
 
+// Requests still queued belong to their caches and are not freed here
+HIST_table::~HIST_table()
+{
+    for( unsigned i=0; i<n_total_sm; i++ ){
+        for( unsigned j=0; j<m_hist_nset*m_hist_assoc; j++ ){
+            delete[] m_hist_table[i][j].filtered_mf;
+            delete[] m_hist_table[i][j].m_add_time;
+        }
+        delete[] m_hist_table[i];
+    }
+    delete[] m_hist_table;
+    delete[] m_flush_time;
+    delete[] recv_mf;
+    delete[] srcn_mf;
+    delete[] inv_msg;
+    delete[] evict_buf;
+    delete[] evict_msg;
+    delete[] nack_mf;
+    delete[] retry_mf;
+    delete[] atom_mf;
+}
+
 void HIST_table::print_config() const
 {
     printf("==HIST: HIST Table configuration\n");
@@ -39,6 +98,14 @@ void HIST_table::print_config() const
     printf("    ==HIST: Total %u\n", n_total_sm);
     printf("    ==HIST: line_log2 %u\n", m_line_sz_log2);
     printf("    ==HIST: n_sm_sqrt %u\n", n_sm_sqrt);
+    printf("    ==HIST: Page %u\n",  m_hist_page_sz);
+    printf("    ==HIST: Atomic %u (latency %u)\n", m_hist_atomic, m_hist_atomic_lat);
+    printf("    ==HIST: Evict notify %u (batch %u)\n", m_hist_evict_notify, m_hist_evict_batch);
+    printf("    ==HIST: Retry %u (wait %u)\n", m_hist_retry_size, m_hist_retry_wait);
+    printf("    ==HIST: Coalesce %u\n", m_hist_coalesce);
+    printf("    ==HIST: Boundary %u (age %u)\n", m_hist_boundary, m_hist_boundary_age);
+    printf("    ==HIST: L1C %u, L1T %u\n", m_gpu->get_config().gpu_hist_const, m_gpu->get_config().gpu_hist_tex);
+    printf("    ==HIST: Flit %u (access energy %.2f pJ)\n", m_flit_size, m_gpu->get_config().gpu_hist_access_energy);
 }
 
 new_addr_type HIST_table::get_key(new_addr_type addr) const
@@ -121,6 +188,13 @@ enum hist_request_status HIST_table::probe( new_addr_type addr ) const
 }
 
 enum hist_request_status HIST_table::probe( new_addr_type addr, unsigned &idx ) const 
+{
+    set_distribute[ get_set_idx( addr ) ]++;
+    return lookup( addr, idx );
+}
+
+// Pisacha: probe() without the set_distribute count
+enum hist_request_status HIST_table::lookup( new_addr_type addr, unsigned &idx ) const 
 {
     unsigned home      = get_home( addr );      // Pisacha: get HOME from address
     unsigned tag       = get_key( addr );       // Pisacha: HIST Key from address (Tag)
@@ -135,13 +209,12 @@ enum hist_request_status HIST_table::probe( new_addr_type addr, unsigned &idx )
     
     unsigned max_time = 0;
     unsigned index;
-    set_distribute[ set_index ]++;
     
     for( index = set_index*m_hist_assoc; index < (set_index+1)*m_hist_assoc; index++ )
     {
         hist_entry_t       *line = &m_hist_table[home][index];
         unsigned             key = line->m_key;
-        hist_entry_status status = line->m_status;
+        hist_entry_status status = live( *line )? line->m_status : HIST_INVALID;
         
         if( line->m_last_access_time > max_time ) // Newest
             max_time = line->m_last_access_time;
@@ -196,6 +269,22 @@ enum hist_request_status HIST_table::probe( new_addr_type addr, unsigned &idx )
     idx = (unsigned)-1;
     return HIST_FULL;
 }
+// Pisacha: Is there a live entry for addr at its home? Unlike probe() this
+//          is not a table access and does not count towards set_distribute.
+bool HIST_table::tracked( new_addr_type addr ) const
+{
+    unsigned home      = get_home( addr );
+    unsigned tag       = get_key( addr );
+    unsigned set_index = get_set_idx( addr );
+
+    for( unsigned index = set_index*m_hist_assoc; index < (set_index+1)*m_hist_assoc; index++ ){
+        const hist_entry_t &line = m_hist_table[home][index];
+        if( line.m_key == tag && line.m_status != HIST_INVALID && live( line ) )
+            return true;
+    }
+    return false;
+}
+
 /*
 int HIST_table::hist_distance(int miss_core_id, new_addr_type addr) const
 {
@@ -225,36 +314,49 @@ void HIST_table::allocate( int miss_core_id, new_addr_type addr, unsigned time )
     assert( probe( addr, idx ) == HIST_MISS );
     assert( check_in_range( miss_core_id, home ) );
 
+    if( !live( m_hist_table[home][idx] ) ){
+        hist_ctr_EPOCH_DROP++;
+    }
     m_hist_table[home][idx].allocate( tag, time );
+    m_hist_table[home][idx].m_epoch = m_epoch;
 }
 
 void HIST_table::add( int miss_core_id, new_addr_type addr, unsigned time )
 {
     unsigned idx;
     unsigned home = get_home( addr );
-    unsigned long long add_HI = 1 << miss_core_id;
+    unsigned long long add_HI = 1ULL << miss_core_id;
     enum hist_request_status probe_res = probe( addr, idx );
 
     assert( probe_res == HIST_HIT_WAIT || probe_res == HIST_HIT_READY );
     assert( check_in_range( miss_core_id, home ) );
 
     m_hist_table[home][idx].m_HI |= add_HI;
+    m_hist_table[home][idx].m_add_time[miss_core_id] = gpu_sim_cycle + gpu_tot_sim_cycle;
     m_hist_table[home][idx].m_last_access_time = time;
+    m_hist_table[home][idx].m_epoch = m_epoch;
 }
 
-void HIST_table::del( int miss_core_id, new_addr_type addr )
+// Pisacha: miss_core_id dropped the line at evict_time. A sharer bit set at or
+//          after that belongs to a later fetch of the line and is kept.
+void HIST_table::del( int miss_core_id, new_addr_type addr, unsigned evict_time )
 {
     unsigned idx;
     unsigned home = get_home( addr );
-    unsigned long long del_HI = 1 << miss_core_id;
+    unsigned long long del_HI = 1ULL << miss_core_id;
     enum hist_request_status probe_res = probe( addr, idx );
 
     if( check_in_range( miss_core_id, home ) == false ){
         return;
     }
+    hist_ctr_TABLE_ACCESS++;
     if( probe_res != HIST_HIT_READY ){
         return;
     }
+    if( ( m_hist_table[home][idx].m_HI & del_HI ) && m_hist_table[home][idx].m_add_time[miss_core_id] >= evict_time ){
+        hist_ctr_EVICT_STALE++;
+        return;
+    }
 
     m_hist_table[home][idx].m_HI &= (~del_HI);
     if( m_hist_table[home][idx].count() == 0 ){
@@ -262,6 +364,259 @@ void HIST_table::del( int miss_core_id, new_addr_type addr )
     }
 }
 
+// Pisacha: A store from write_core_id, through its L1D or around it. If HIST
+//          knows remote sharers of the line, the home sends them
+//          invalidations and the entry is dropped. An entry still waiting for
+//          its fill would hand out data read before the store: the requests
+//          parked on it are NACKed back to L2 and the entry is dropped, so the
+//          fill on its way does not make it READY.
+void HIST_table::write( int write_core_id, new_addr_type addr, unsigned time )
+{
+    unsigned idx, SM;
+    unsigned home = get_home( addr );
+    enum hist_request_status probe_res = probe( addr, idx );
+
+    if( probe_res != HIST_HIT_READY && probe_res != HIST_HIT_WAIT ){
+        return;
+    }
+
+    hist_entry_t *line = &m_hist_table[home][idx];
+    unsigned req_d = NOC_distance( write_core_id, home );
+    if( probe_res == HIST_HIT_WAIT ){
+        hist_ctr_TABLE_ACCESS++;
+        noc_traffic( HIST_MSG_INV, write_core_id, home, READ_PACKET_SIZE );
+        for( SM = 0; SM < n_total_sm; SM++ ){
+            while( !line->filtered_mf[SM].empty() ){
+                mem_fetch *pending_mf = line->filtered_mf[SM].front();
+                pending_mf->set_wait( req_d + m_hist_delay + NOC_distance( home, SM ) + 1 );
+                nack_mf[SM].push_back( pending_mf );
+                noc_traffic( HIST_MSG_NACK, home, SM, READ_PACKET_SIZE );
+                line->filtered_mf[SM].pop_front();
+                hist_ctr_INV_WAIT++;
+            }
+        }
+        line->m_status = HIST_INVALID;
+        line->m_HI     = 0;
+        line->m_last_access_time = time;
+        return;
+    }
+    hist_ctr_INV_WRITE++;
+    hist_ctr_TABLE_ACCESS++;
+    noc_traffic( HIST_MSG_INV, write_core_id, home, READ_PACKET_SIZE );
+
+    for( SM = 0; SM < n_total_sm; SM++ ){
+        if( (int)SM == write_core_id || !is_sharer( *line, SM ) )
+            continue;
+        unsigned inv_d = NOC_distance( home, SM );
+        inv_msg[SM].push_back( hist_msg_t( home, addr, req_d + m_hist_delay + inv_d, time ) );
+        noc_traffic( HIST_MSG_INV, home, SM, READ_PACKET_SIZE );
+        hist_ctr_INV_MSG++;
+        hist_ctr_INV_HOPS += inv_d;
+    }
+
+    line->m_status = HIST_INVALID;
+    line->m_HI     = 0;
+    line->m_last_access_time = time;
+}
+
+// Pisacha: Execute an atomic at the HIST home of its line instead of at L2.
+//          Only taken when the requester is in range of the home and the home
+//          entry is READY. The request pays the round trip to the home plus
+//          the atomic latency. Afterwards every sharer, the home included, is
+//          invalidated as for a store and the entry is dropped.
+bool HIST_table::atomic( int core_id, mem_fetch *mf, unsigned time )
+{
+    unsigned idx, SM;
+    new_addr_type addr = mf->get_addr();
+    unsigned home = get_home( addr );
+
+    if( !m_hist_atomic || !check_in_range( core_id, home ) || probe( addr, idx ) != HIST_HIT_READY ){
+        hist_ctr_ATOM_L2++;
+        return false;
+    }
+
+    hist_entry_t *line = &m_hist_table[home][idx];
+    unsigned NOC_d  = NOC_distance( core_id, home );
+    unsigned arrive = time + NOC_d;
+    unsigned start  = arrive > line->m_atomic_free_time? arrive : line->m_atomic_free_time;
+
+    line->m_atomic_free_time = start + m_hist_atomic_lat;
+    line->m_last_access_time = time;
+
+    for( SM = 0; SM < n_total_sm; SM++ ){
+        if( !is_sharer( *line, SM ) )
+            continue;
+        inv_msg[SM].push_back( hist_msg_t( home, addr, NOC_d + m_hist_delay + NOC_distance( home, SM ), time ) );
+        noc_traffic( HIST_MSG_INV, home, SM, READ_PACKET_SIZE );
+        hist_ctr_INV_MSG++;
+        hist_ctr_INV_HOPS += NOC_distance( home, SM );
+    }
+    // Pisacha: every cached copy is now stale and the requester does not
+    //          cache the result, so nobody is left to forward from
+    line->m_HI = 0;
+    line->m_status = HIST_INVALID;
+
+    // Functional execution happens at the home, reply goes back to the requester
+    mf->do_atomic();
+    mf->set_reply();
+    mf->set_wait( line->m_atomic_free_time + NOC_d - time + 1, time, NULL );
+    atom_mf[core_id].push_back( mf );
+    hist_stage( mf, MF_STAGE_HIST_LOOKUP );
+    noc_traffic( HIST_MSG_ATOMIC, core_id, home, mf->size() );
+    noc_traffic( HIST_MSG_ATOMIC, home, core_id, mf->size() );
+
+    hist_ctr_TABLE_ACCESS++;
+    hist_ctr_ATOM_NEAR++;
+    hist_ctr_ATOM_QUEUE += start - arrive;
+    hist_ctr_ATOM_LAT   += line->m_atomic_free_time + NOC_d - time;
+    return true;
+}
+
+// Pisacha: L1 eviction seen by core_id, from the cache of type type_id. The
+//          SM stays a sharer while another of its L1s still holds the line.
+//          Without eviction notifications the home is updated immediately.
+//          Otherwise the notification waits in the per-SM batching buffer and
+//          then travels to the home.
+void HIST_table::evict( int core_id, new_addr_type addr, int type_id )
+{
+    unsigned time = gpu_sim_cycle + gpu_tot_sim_cycle;
+
+    if( m_gpu->hist_holds( core_id, addr, type_id ) ){
+        return;
+    }
+
+    if( !m_hist_evict_notify ){
+        del( core_id, addr, time );
+        return;
+    }
+    evict_buf[core_id].push_back( hist_msg_t( core_id, addr, 0, time ) );
+    if( evict_buf[core_id].size() >= m_hist_evict_batch ){
+        send_evict( core_id );
+    }
+}
+
+// Pisacha: core_id flushed its L1D. Its sharer bits are not walked one line
+//          at a time: every bit it set up to now is dead from here on, which
+//          is_sharer() checks against the bit's add time. Entries left with no
+//          live sharer are dropped when next probed. Bits the SM holds for
+//          its constant or texture L1s go too, which only costs forwards.
+void HIST_table::flush_sm( int core_id )
+{
+    evict_buf[core_id].clear();
+    m_flush_time[core_id] = gpu_sim_cycle + gpu_tot_sim_cycle + 1;
+    hist_ctr_TABLE_ACCESS++;
+}
+
+// Pisacha: A batch goes out as one message per home it names. The first
+//          notice fills a control packet, each further one adds its key.
+void HIST_table::send_evict( int core_id )
+{
+    std::vector<unsigned> n_notice( n_total_sm, 0 );
+
+    if( evict_buf[core_id].empty() ){
+        return;
+    }
+    while( !evict_buf[core_id].empty() ){
+        hist_msg_t msg  = evict_buf[core_id].front();
+        unsigned   home = get_home( msg.m_addr );
+
+        msg.m_wait = NOC_distance( core_id, home ) + 1;
+        evict_msg[home].push_back( msg );
+        evict_buf[core_id].pop_front();
+        n_notice[home]++;
+    }
+    for( unsigned home=0; home<n_total_sm; home++ ){
+        if( n_notice[home] == 0 )
+            continue;
+        noc_traffic( HIST_MSG_EVICT, core_id, home, READ_PACKET_SIZE + ( n_notice[home] - 1 ) * sizeof(unsigned) );
+        hist_ctr_EVICT_MSG++;
+    }
+    hist_ctr_EVICT_BATCH++;
+}
+
+// Pisacha: The home forwards a READY hit from the sharer closest to it, -1 if
+//          the requester is the only one left.
+int HIST_table::forward_sharer( int miss_core_id, unsigned idx, new_addr_type addr ) const
+{
+    unsigned SM;
+    unsigned home     = get_home( addr );
+    int      sharer   = -1;
+    unsigned sharer_d = 0;
+
+    const hist_entry_t *line = &m_hist_table[home][idx];
+    for( SM = 0; SM < n_total_sm; SM++ ){
+        if( (int)SM == miss_core_id || !is_sharer( *line, SM ) )
+            continue;
+        if( sharer == -1 || NOC_distance( home, SM ) < sharer_d ){
+            sharer   = SM;
+            sharer_d = NOC_distance( home, SM );
+        }
+    }
+    return sharer;
+}
+
+// Pisacha: A forward reached miss_core_id. With delayed eviction notifications
+//          the sharer it was served by may have dropped the line meanwhile:
+//          it NACKs, the home clears its bit and the requester retries to L2
+//          after the extra round trip to that sharer.
+bool HIST_table::stale_forward( int miss_core_id, mem_fetch *mf )
+{
+    tr1_hash_map<mem_fetch*,int>::iterator it = m_fwd_sharer.find( mf );
+    if( it == m_fwd_sharer.end() ){
+        return false;
+    }
+    unsigned sharer = it->second;
+    m_fwd_sharer.erase( it );
+    if( m_gpu->hist_holds( sharer, mf->get_addr() ) ){
+        return false;
+    }
+
+    unsigned idx;
+    unsigned home     = get_home( mf->get_addr() );
+    unsigned sharer_d = NOC_distance( home, sharer );
+    if( probe( mf->get_addr(), idx ) == HIST_HIT_READY ){
+        hist_entry_t *line = &m_hist_table[home][idx];
+        line->m_HI &= ~( 1ULL << sharer );
+        if( line->count() == 0 ){
+            line->m_status = HIST_INVALID;
+        }
+    }
+    noc_traffic( HIST_MSG_NACK, home, sharer, READ_PACKET_SIZE );
+    noc_traffic( HIST_MSG_NACK, sharer, home, READ_PACKET_SIZE );
+    noc_traffic( HIST_MSG_NACK, home, miss_core_id, READ_PACKET_SIZE );
+
+    // the forward itself took m_hist_delay plus the home distance already
+    unsigned nack_d = m_hist_delay + 2*sharer_d + NOC_distance( miss_core_id, home );
+    mf->set_wait( 2*sharer_d + 1 );
+    nack_mf[miss_core_id].push_back( mf );
+    hist_ctr_STALE++;
+    hist_ctr_STALE_LAT += nack_d;
+    return true;
+}
+
+void HIST_table::print_stale_stats() const
+{
+    unsigned long long forwards = hist_ctr_READY + hist_ctr_GPROBE_S + hist_ctr_STALE;
+
+    printf("hist_ctr_EVICT_MSG = %lld\n", hist_ctr_EVICT_MSG);
+    printf("hist_ctr_EVICT_BATCH = %lld\n", hist_ctr_EVICT_BATCH);
+    printf("hist_ctr_STALE = %lld\n", hist_ctr_STALE);
+    printf("hist_ctr_STALE_LAT = %lld\n", hist_ctr_STALE_LAT);
+    printf("hist_ctr_EVICT_STALE = %lld\n", hist_ctr_EVICT_STALE);
+    printf("hist_stale_forward_rate = %.4f\n", forwards? (float)hist_ctr_STALE / forwards : 0.0f);
+}
+
+void HIST_table::print_retry_stats() const
+{
+    unsigned long long retry_done = hist_ctr_RETRY_OK + hist_ctr_RETRY_FAIL;
+
+    printf("hist_ctr_RETRY = %lld\n", hist_ctr_RETRY);
+    printf("hist_ctr_RETRY_OK = %lld\n", hist_ctr_RETRY_OK);
+    printf("hist_ctr_RETRY_FAIL = %lld\n", hist_ctr_RETRY_FAIL);
+    printf("hist_ctr_RETRY_LAT = %lld\n", hist_ctr_RETRY_LAT);
+    printf("hist_retry_avg_lat = %.4f\n", retry_done? (float)hist_ctr_RETRY_LAT / retry_done : 0.0f);
+}
+
 void HIST_table::ready( int miss_core_id, new_addr_type addr, unsigned time )
 {
     unsigned idx;
@@ -270,8 +625,10 @@ void HIST_table::ready( int miss_core_id, new_addr_type addr, unsigned time )
     assert( probe( addr, idx ) == HIST_HIT_WAIT );
     assert( check_in_range( miss_core_id, home ) );
 
+    hist_ctr_TABLE_ACCESS++;
     m_hist_table[home][idx].m_status = HIST_READY;
     m_hist_table[home][idx].m_last_access_time = time;
+    m_hist_table[home][idx].m_epoch = m_epoch;
 }
 
 void HIST_table::refresh( int miss_core_id, new_addr_type addr, unsigned time )
@@ -283,6 +640,7 @@ void HIST_table::refresh( int miss_core_id, new_addr_type addr, unsigned time )
     assert( check_in_range( miss_core_id, home ) == false );
 
     m_hist_table[home][idx].m_last_access_time = time;
+    m_hist_table[home][idx].m_epoch = m_epoch;
 }
 
 void HIST_table::add_mf( int miss_core_id, new_addr_type addr, mem_fetch *mf )
@@ -294,12 +652,21 @@ void HIST_table::add_mf( int miss_core_id, new_addr_type addr, mem_fetch *mf )
     assert( check_in_range( miss_core_id, home ) );
 
     m_hist_table[home][idx].filtered_mf[miss_core_id].push_back( mf );
+    hist_stage( mf, MF_STAGE_HIST_FILTERED );
 }
 
 void HIST_table::probe_dest( new_addr_type addr, mem_fetch *mf )
 {
     recv_mf[get_home(addr)].push_back( mf );
     mf->set_wait( 0 );
+    hist_stage( mf, MF_STAGE_HIST_LOOKUP );
+    noc_traffic( HIST_MSG_PROBE, mf->get_sid(), get_home(addr), READ_PACKET_SIZE );
+    if( mf->isconst() ){
+        hist_ctr_CONST_TOT++;
+    }
+    else if( mf->istexture() ){
+        hist_ctr_TEX_TOT++;
+    }
 }
 
 void HIST_table::process_probe( int miss_core_id, mem_fetch *mf )
@@ -307,9 +674,24 @@ void HIST_table::process_probe( int miss_core_id, mem_fetch *mf )
     std::list<mem_fetch*> *miss_queue = mf->get_miss_queue();
     new_addr_type addr = mf->get_addr();
     
+    unsigned idx;
     unsigned home  = get_home( addr );
     unsigned NOC_d = NOC_distance( miss_core_id, home );
-    enum hist_request_status probe_res = probe( addr );
+    enum hist_request_status probe_res = probe( addr, idx );
+    int sharer = -1;
+
+    if( probe_res == HIST_HIT_READY ){
+        sharer = forward_sharer( miss_core_id, idx, addr );
+        if( sharer == -1 ){
+            // Pisacha: only the requester's own bit is left, its eviction
+            //          notice is still on the way, or every other sharer has
+            //          flushed its L1 since: there is nothing to forward
+            //          from, so the entry is dropped and this is a miss
+            m_hist_table[home][idx].m_HI = 0;
+            m_hist_table[home][idx].m_status = HIST_INVALID;
+            probe_res = probe( addr, idx );
+        }
+    }
     
     if( check_in_range( miss_core_id, home ) ){
         if( probe_res == HIST_MISS ){
@@ -318,6 +700,7 @@ void HIST_table::process_probe( int miss_core_id, mem_fetch *mf )
             add( miss_core_id, addr, mf->get_time() );
             
             miss_queue->push_back( mf );
+            hist_stage( mf, mf->get_status() );
             hist_ctr_MISS++;
         }
         else if( probe_res == HIST_HIT_WAIT ){
@@ -332,13 +715,27 @@ void HIST_table::process_probe( int miss_core_id, mem_fetch *mf )
             add( miss_core_id, addr, mf->get_time() );
             
             recv_mf[miss_core_id].push_back( mf );
+            if( sharer != -1 )
+                m_fwd_sharer[mf] = sharer;
             mf->set_wait( m_hist_delay + NOC_d );
+            hist_stage( mf, MF_STAGE_HIST_FORWARD );
+            noc_traffic( HIST_MSG_FORWARD, home, miss_core_id, m_line_sz + READ_PACKET_SIZE );
             hist_ctr_READY++;
         }
         else{
             assert( probe_res == HIST_FULL );
             //printf("==HIST: SM[%3u] %#010x set %u - HIST_FULL\n", miss_core_id, addr, get_set_idx( addr ));
-            miss_queue->push_back( mf );
+            // Pisacha: hist_ctr_FULL counts every probe that found its set
+            //          full, parked or not; hist_ctr_RETRY_FAIL those parked
+            //          ones that went to L2 after all
+            if( retry_mf[home].size() < m_hist_retry_size ){
+                retry_mf[home].push_back( hist_retry_t( mf ) );
+                hist_ctr_RETRY++;
+            }
+            else{
+                miss_queue->push_back( mf );
+                hist_stage( mf, mf->get_status() );
+            }
             hist_ctr_FULL++;
         }
         //print_set( addr );
@@ -348,21 +745,155 @@ void HIST_table::process_probe( int miss_core_id, mem_fetch *mf )
         if( probe_res == HIST_HIT_READY ){
             refresh( miss_core_id, addr, mf->get_time() );
             recv_mf[miss_core_id].push_back( mf );
+            if( sharer != -1 )
+                m_fwd_sharer[mf] = sharer;
             mf->set_wait( m_hist_delay + NOC_d );
+            hist_stage( mf, MF_STAGE_HIST_FORWARD );
+            noc_traffic( HIST_MSG_FORWARD, home, miss_core_id, m_line_sz + READ_PACKET_SIZE );
             hist_ctr_GPROBE_S++;
         }
         else{
             miss_queue->push_back( mf );
+            hist_stage( mf, mf->get_status() );
             hist_ctr_GPROBE_F++;
         }
     }
 }
 
+// Pisacha: Requests that found their set FULL wait at the home for up to
+//          m_hist_retry_wait cycles, then fall back to their original miss
+//          queue. Each cycle the oldest one whose set has a free entry by now
+//          is processed again, so one stuck on a busy set does not hold up
+//          those behind it. Checking a set is not a table access and does not
+//          count towards set_distribute.
+void HIST_table::retry_cycle( int home )
+{
+    std::list<hist_retry_t>::iterator it = retry_mf[home].begin();
+    while( it != retry_mf[home].end() ){
+        it->m_wait++;
+        it->m_mf->hist_cycle();
+        if( it->m_wait > m_hist_retry_wait ){
+            it->m_mf->get_miss_queue()->push_back( it->m_mf );
+            hist_stage( it->m_mf, it->m_mf->get_status() );
+            hist_ctr_RETRY_FAIL++;
+            hist_ctr_RETRY_LAT += it->m_wait;
+            it = retry_mf[home].erase( it );
+            continue;
+        }
+        it++;
+    }
+
+    for( it = retry_mf[home].begin(); it != retry_mf[home].end(); it++ ){
+        unsigned idx;
+        if( lookup( it->m_mf->get_addr(), idx ) == HIST_FULL )
+            continue;
+        hist_retry_t retry = *it;
+        retry_mf[home].erase( it );
+        hist_ctr_RETRY_OK++;
+        hist_ctr_RETRY_LAT += retry.m_wait;
+        hist_ctr_TABLE_ACCESS++;
+        process_probe( retry.m_mf->get_sid(), retry.m_mf );
+        break;
+    }
+}
+
+// Pisacha: Probes for the same key that are waiting at the home in the same
+//          cycle as the one just processed join its table transaction. They
+//          are handled in this cycle without another table access, so after
+//          a leader MISS the followers are recorded as sharers of the new
+//          entry instead of probing again in later cycles.
+void HIST_table::coalesce( int home, new_addr_type addr )
+{
+    std::vector<mem_fetch*> requesters;
+    std::list<mem_fetch*>::iterator it = recv_mf[home].begin();
+
+    while( it != recv_mf[home].end() ){
+        mem_fetch *mf_ptr = *it;
+        if( mf_ptr->get_wait() == 0 && get_key( mf_ptr->get_addr() ) == get_key( addr ) ){
+            requesters.push_back( mf_ptr );
+            it = recv_mf[home].erase( it );
+            continue;
+        }
+        it++;
+    }
+
+    for( unsigned i = 0; i < requesters.size(); i++ ){
+        process_probe( requesters[i]->get_sid(), requesters[i] );
+    }
+    if( requesters.size() > 0 ){
+        hist_ctr_MERGE_TXN++;
+        hist_ctr_MERGE += requesters.size();
+    }
+}
+
 void HIST_table::recv_cycle( int core_id )
 {
     std::list<mem_fetch*>::iterator it     = recv_mf[core_id].begin();
     std::list<mem_fetch*>::iterator it_min = recv_mf[core_id].end();
     int min_cycle = MAX_INT;
+
+    std::list<hist_msg_t>::iterator it_inv = inv_msg[core_id].begin();
+    while( it_inv != inv_msg[core_id].end() ){
+        if( it_inv->m_wait <= 1 ){
+            if( m_gpu->hist_invalidate( core_id, it_inv->m_addr ) )
+                hist_ctr_INV_HIT++;
+            it_inv = inv_msg[core_id].erase( it_inv );
+            continue;
+        }
+        it_inv->m_wait--;
+        it_inv++;
+    }
+
+    std::list<hist_msg_t>::iterator it_evict = evict_msg[core_id].begin();
+    while( it_evict != evict_msg[core_id].end() ){
+        if( it_evict->m_wait <= 1 ){
+            del( it_evict->m_core, it_evict->m_addr, it_evict->m_time );
+            it_evict = evict_msg[core_id].erase( it_evict );
+            continue;
+        }
+        it_evict->m_wait--;
+        it_evict++;
+    }
+    // Batching buffer: a partial batch is sent once its oldest entry waited a full batch time
+    for( it_evict = evict_buf[core_id].begin(); it_evict != evict_buf[core_id].end(); it_evict++ ){
+        it_evict->m_wait++;
+    }
+    if( !evict_buf[core_id].empty() && evict_buf[core_id].front().m_wait >= m_hist_evict_batch ){
+        send_evict( core_id );
+    }
+
+    it = atom_mf[core_id].begin();
+    while( it != atom_mf[core_id].end() ){
+        mem_fetch *mf_ptr = *it;
+        if( mf_ptr->get_wait() <= 1 ){
+            if( m_gpu->hist_response_full( core_id ) ){
+                hist_ctr_EJECT_BP++;
+                it++;
+                continue;
+            }
+            m_gpu->fill_respond_queue( core_id, mf_ptr );
+            it = atom_mf[core_id].erase( it );
+            continue;
+        }
+        mf_ptr->hist_cycle();
+        it++;
+    }
+
+    retry_cycle( core_id );
+
+    it = nack_mf[core_id].begin();
+    while( it != nack_mf[core_id].end() ){
+        mem_fetch *mf_ptr = *it;
+        if( mf_ptr->get_wait() <= 1 ){
+            mf_ptr->get_miss_queue()->push_back( mf_ptr );
+            hist_stage( mf_ptr, mf_ptr->get_status() );
+            it = nack_mf[core_id].erase( it );
+            continue;
+        }
+        mf_ptr->hist_cycle();
+        it++;
+    }
+    it = recv_mf[core_id].begin();
     
     while( it != recv_mf[core_id].end() ){
         mem_fetch *mf_ptr = *it;
@@ -387,15 +918,35 @@ void HIST_table::recv_cycle( int core_id )
             assert( mf_ptr->get_wait() == 0 );
             process_probe( mf_ptr->get_sid(), mf_ptr );
             recv_mf[core_id].erase( it_min );
+            hist_ctr_TABLE_ACCESS++;
+            if( m_hist_coalesce ){
+                coalesce( core_id, addr );
+            }
         }
         else if( min_cycle == 1 ){
             assert( mf_ptr->get_wait() == 1 );
             assert( mf_ptr->get_sid() == core_id );
+            if( probe_res == HIST_HIT_READY && m_gpu->hist_response_full( core_id ) ){
+                hist_ctr_EJECT_BP++;    // Pisacha: ejection port full, retry next cycle
+                return;
+            }
+            if( probe_res == HIST_HIT_READY && stale_forward( core_id, mf_ptr ) ){
+                recv_mf[core_id].erase( it_min );   // Pisacha: NACKed by a stale sharer, retried to L2
+                return;
+            }
+            m_fwd_sharer.erase( mf_ptr );
             if( probe_res == HIST_HIT_READY ){
+                if( mf_ptr->isconst() ){
+                    hist_ctr_CONST_FWD++;
+                }
+                else if( mf_ptr->istexture() ){
+                    hist_ctr_TEX_FWD++;
+                }
                 m_gpu->fill_respond_queue( core_id, mf_ptr );
             }
             else{
                 miss_queue->push_back( mf_ptr );
+                hist_stage( mf_ptr, mf_ptr->get_status() );
                 hist_ctr_FREADY++;
             }
             recv_mf[core_id].erase( it_min );
@@ -407,6 +958,79 @@ void HIST_table::recv_cycle( int core_id )
     }
 }
 
+new_addr_type HIST_table::get_page( new_addr_type addr ) const
+{
+    return addr / m_hist_page_sz;
+}
+
+enum hist_page_class HIST_table::page_access( int core_id, new_addr_type addr, bool write )
+{
+    assert( page_filter_enabled() );
+    hist_page_t &page = m_page_table[ get_page( addr ) ];
+
+    page.m_sharer |= ( 1ULL << core_id );
+    if( write )
+        page.m_written = true;
+    return page.get_class();
+}
+
+// Pisacha: Decide whether a read miss should skip HIST and go directly to L2.
+//          Local memory is private by construction, and so is any page that
+//          only one SM has touched so far. A page is PRIVATE on its first
+//          touch, so the first SM to miss on a page always bypasses HIST.
+//          A bypassed miss in range of a home that does not track its line
+//          is an entry the classifier kept out of the table.
+bool HIST_table::bypass( int core_id, mem_fetch *mf )
+{
+    if( !page_filter_enabled() )
+        return false;
+
+    if( mf->get_access_type() == LOCAL_ACC_R ){
+        hist_ctr_BYPASS_LOCAL++;
+        if( check_in_range( core_id, get_home( mf->get_addr() ) ) && !tracked( mf->get_addr() ) )
+            hist_ctr_BYPASS_ALLOC++;
+        return true;
+    }
+
+    switch( page_access( core_id, mf->get_addr(), false ) ){
+    case HIST_PAGE_PRIVATE:
+        hist_ctr_PAGE_PRIVATE++;
+        hist_ctr_BYPASS_PRIVATE++;
+        if( check_in_range( core_id, get_home( mf->get_addr() ) ) && !tracked( mf->get_addr() ) )
+            hist_ctr_BYPASS_ALLOC++;
+        return true;
+    case HIST_PAGE_SHARED_RO:
+        hist_ctr_PAGE_SHARED_RO++;
+        break;
+    case HIST_PAGE_SHARED_RW:
+        hist_ctr_PAGE_SHARED_RW++;
+        break;
+    }
+    return false;
+}
+
+void HIST_table::print_page_stats() const
+{
+    unsigned long long n_page[3] = { 0, 0, 0 };
+
+    if( !page_filter_enabled() )
+        return;
+
+    for( page_table_t::const_iterator it = m_page_table.begin(); it != m_page_table.end(); it++ )
+        n_page[ it->second.get_class() ]++;
+
+    printf("hist_page_PRIVATE = %lld\n",   n_page[HIST_PAGE_PRIVATE]);
+    printf("hist_page_SHARED_RO = %lld\n", n_page[HIST_PAGE_SHARED_RO]);
+    printf("hist_page_SHARED_RW = %lld\n", n_page[HIST_PAGE_SHARED_RW]);
+
+    // Pisacha: HIST capacity freed, an entry is its key, one HI bit per SM and the status
+    unsigned entry_bytes = ( 32 + n_total_sm + 2 + 7 ) / 8;
+    printf("hist_page_saved_entries = %lld\n", hist_ctr_BYPASS_ALLOC);
+    printf("hist_page_saved_bytes = %lld\n", hist_ctr_BYPASS_ALLOC * entry_bytes);
+    printf("hist_page_saved_fraction = %.4f\n", ( hist_ctr_BYPASS_ALLOC + hist_ctr_MISS )? 
+           (float)hist_ctr_BYPASS_ALLOC / ( hist_ctr_BYPASS_ALLOC + hist_ctr_MISS ) : 0.0f);
+}
+
 void HIST_table::fill_wait( int miss_core_id, new_addr_type addr )
 {
     unsigned idx, SM;
@@ -423,12 +1047,240 @@ void HIST_table::fill_wait( int miss_core_id, new_addr_type addr )
             
             recv_mf[SM].push_back( pending_mf );
             pending_mf->set_wait( m_hist_delay + NOC_distance( miss_core_id, home ) );
+            hist_stage( pending_mf, MF_STAGE_HIST_FORWARD );
+            noc_traffic( HIST_MSG_FORWARD, miss_core_id, SM, m_line_sz + READ_PACKET_SIZE );
             
             m_hist_table[home][idx].filtered_mf[SM].pop_front();
         }
     }
 }
 
+// Pisacha: A kernel is about to start. Eviction notifications still batched
+//          from the previous kernel's L1 flush are sent now instead of
+//          straddling into the new kernel.
+void HIST_table::kernel_launch()
+{
+    for( unsigned i=0; i<n_total_sm; i++ ){
+        send_evict( i );
+    }
+}
+
+// Pisacha: The last running kernel finished. FLUSH and AGE only bump the
+//          epoch; entries are checked lazily by live() when probe() walks a
+//          set, so the boundary costs O(1) whatever the table size. It is not
+//          called while other kernels still run, since their READY entries
+//          would go with it. WAIT entries are never dropped.
+void HIST_table::kernel_finish()
+{
+    if( m_hist_boundary == HIST_BOUNDARY_RETAIN ){
+        return;
+    }
+    m_epoch++;
+    hist_ctr_EPOCH++;
+}
+
+// Pisacha: Checkpoint of the table. Control messages are plain data and
+//          restored as is; requests in flight are written as request ids
+//          only, and dropped on restore with the WAIT entries they fill.
+static void save_mf_list( FILE *fp, const std::list<mem_fetch*> &mf_list )
+{
+    unsigned n = mf_list.size();
+    ckpt_write( fp, n );
+    for( std::list<mem_fetch*>::const_iterator it = mf_list.begin(); it != mf_list.end(); it++ ){
+        unsigned uid = (*it)->get_request_uid();
+        ckpt_write( fp, uid );
+    }
+}
+
+static unsigned load_mf_list( FILE *fp )
+{
+    unsigned n, uid;
+    ckpt_read( fp, n );
+    for( unsigned i=0; i<n; i++ ){
+        ckpt_read( fp, uid );
+    }
+    return n;
+}
+
+static void save_msg_list( FILE *fp, const std::list<hist_msg_t> &msg_list )
+{
+    unsigned n = msg_list.size();
+    ckpt_write( fp, n );
+    for( std::list<hist_msg_t>::const_iterator it = msg_list.begin(); it != msg_list.end(); it++ ){
+        ckpt_write( fp, it->m_core );
+        ckpt_write( fp, it->m_addr );
+        ckpt_write( fp, it->m_wait );
+        ckpt_write( fp, it->m_time );
+    }
+}
+
+static void load_msg_list( FILE *fp, std::list<hist_msg_t> &msg_list )
+{
+    unsigned n;
+    ckpt_read( fp, n );
+    msg_list.clear();
+    for( unsigned i=0; i<n; i++ ){
+        hist_msg_t msg( 0, 0, 0, 0 );
+        ckpt_read( fp, msg.m_core );
+        ckpt_read( fp, msg.m_addr );
+        ckpt_read( fp, msg.m_wait );
+        ckpt_read( fp, msg.m_time );
+        msg_list.push_back( msg );
+    }
+}
+
+void HIST_table::save_state( FILE *fp ) const
+{
+    ckpt_write( fp, n_total_sm );
+    ckpt_write( fp, m_hist_nset );
+    ckpt_write( fp, m_hist_assoc );
+    ckpt_write( fp, m_epoch );
+    for( unsigned SM=0; SM<n_total_sm; SM++ ){
+        ckpt_write( fp, m_flush_time[SM] );
+    }
+
+    for( unsigned home=0; home<n_total_sm; home++ ){
+        for( unsigned i=0; i<m_hist_nset*m_hist_assoc; i++ ){
+            const hist_entry_t &line = m_hist_table[home][i];
+            unsigned status = line.m_status;
+            ckpt_write( fp, status );
+            ckpt_write( fp, line.m_key );
+            ckpt_write( fp, line.m_HI );
+            ckpt_write( fp, line.m_alloc_time );
+            ckpt_write( fp, line.m_last_access_time );
+            ckpt_write( fp, line.m_fill_time );
+            ckpt_write( fp, line.m_atomic_free_time );
+            ckpt_write( fp, line.m_epoch );
+            for( unsigned SM=0; SM<n_total_sm; SM++ ){
+                ckpt_write( fp, line.m_add_time[SM] );
+                save_mf_list( fp, line.filtered_mf[SM] );
+            }
+        }
+    }
+
+    for( unsigned SM=0; SM<n_total_sm; SM++ ){
+        std::list<mem_fetch*> retry_list;
+        for( std::list<hist_retry_t>::const_iterator it = retry_mf[SM].begin(); it != retry_mf[SM].end(); it++ ){
+            retry_list.push_back( it->m_mf );
+        }
+        save_mf_list( fp, recv_mf[SM] );
+        save_mf_list( fp, srcn_mf[SM] );
+        save_mf_list( fp, nack_mf[SM] );
+        save_mf_list( fp, atom_mf[SM] );
+        save_mf_list( fp, retry_list );
+        save_msg_list( fp, inv_msg[SM] );
+        save_msg_list( fp, evict_buf[SM] );
+        save_msg_list( fp, evict_msg[SM] );
+    }
+
+    unsigned n_page = m_page_table.size();
+    ckpt_write( fp, n_page );
+    for( page_table_t::const_iterator it = m_page_table.begin(); it != m_page_table.end(); it++ ){
+        unsigned written = it->second.m_written;
+        ckpt_write( fp, it->first );
+        ckpt_write( fp, it->second.m_sharer );
+        ckpt_write( fp, written );
+    }
+}
+
+void HIST_table::load_state( FILE *fp )
+{
+    unsigned n_sm, nset, assoc;
+    unsigned dropped = 0;
+
+    ckpt_read( fp, n_sm );
+    ckpt_read( fp, nset );
+    ckpt_read( fp, assoc );
+    if( n_sm != n_total_sm || nset != m_hist_nset || assoc != m_hist_assoc ){
+        printf("GPGPU-Sim: checkpoint HIST table is %u SMs x %u sets x %u ways, configured %u x %u x %u\n",
+               n_sm, nset, assoc, n_total_sm, m_hist_nset, m_hist_assoc);
+        abort();
+    }
+    ckpt_read( fp, m_epoch );
+    for( unsigned SM=0; SM<n_total_sm; SM++ ){
+        ckpt_read( fp, m_flush_time[SM] );
+    }
+
+    for( unsigned home=0; home<n_total_sm; home++ ){
+        for( unsigned i=0; i<m_hist_nset*m_hist_assoc; i++ ){
+            hist_entry_t &line = m_hist_table[home][i];
+            unsigned status;
+            ckpt_read( fp, status );
+            ckpt_read( fp, line.m_key );
+            ckpt_read( fp, line.m_HI );
+            ckpt_read( fp, line.m_alloc_time );
+            ckpt_read( fp, line.m_last_access_time );
+            ckpt_read( fp, line.m_fill_time );
+            ckpt_read( fp, line.m_atomic_free_time );
+            ckpt_read( fp, line.m_epoch );
+            for( unsigned SM=0; SM<n_total_sm; SM++ ){
+                assert( line.filtered_mf[SM].empty() );
+                ckpt_read( fp, line.m_add_time[SM] );
+                dropped += load_mf_list( fp );
+            }
+            line.m_status = ( status == HIST_WAIT )? HIST_INVALID : (enum hist_entry_status)status;
+        }
+    }
+
+    for( unsigned SM=0; SM<n_total_sm; SM++ ){
+        assert( recv_mf[SM].empty() && srcn_mf[SM].empty() && nack_mf[SM].empty() );
+        assert( atom_mf[SM].empty() && retry_mf[SM].empty() );
+        assert( m_fwd_sharer.empty() );
+        dropped += load_mf_list( fp );
+        dropped += load_mf_list( fp );
+        dropped += load_mf_list( fp );
+        dropped += load_mf_list( fp );
+        dropped += load_mf_list( fp );
+        load_msg_list( fp, inv_msg[SM] );
+        load_msg_list( fp, evict_buf[SM] );
+        load_msg_list( fp, evict_msg[SM] );
+    }
+
+    unsigned n_page;
+    ckpt_read( fp, n_page );
+    m_page_table.clear();
+    for( unsigned i=0; i<n_page; i++ ){
+        new_addr_type page;
+        unsigned written;
+        ckpt_read( fp, page );
+        hist_page_t &entry = m_page_table[page];
+        ckpt_read( fp, entry.m_sharer );
+        ckpt_read( fp, written );
+        entry.m_written = ( written != 0 );
+    }
+    if( dropped > 0 ){
+        printf("GPGPU-Sim: %u in-flight HIST requests in checkpoint dropped\n", dropped);
+    }
+}
+
+// Pisacha: Account one HIST message of 'size' bytes. Flits also go to the
+//          per-SM HIST counters next to the interconnect power stats.
+void HIST_table::noc_traffic( enum hist_msg_type type, int src, int dst, unsigned size )
+{
+    unsigned flits = ( size + m_flit_size - 1 ) / m_flit_size;
+
+    m_msg_count[type]++;
+    m_msg_flits[type]     += flits;
+    m_msg_flit_hops[type] += flits * NOC_distance( src, dst );
+    m_gpu->hist_icnt_power( src, dst, flits );
+}
+
+void HIST_table::print_noc_stats() const
+{
+    static const char *msg_name[N_HIST_MSG_TYPE] = { "PROBE", "FORWARD", "NACK", "INV", "EVICT", "ATOMIC" };
+    unsigned long long tot_flits = 0, tot_flit_hops = 0;
+
+    for( unsigned i=0; i<N_HIST_MSG_TYPE; i++ ){
+        printf("hist_noc_%s: msgs = %lld, flits = %lld, flit_hops = %lld\n", msg_name[i],
+               m_msg_count[i], m_msg_flits[i], m_msg_flit_hops[i]);
+        tot_flits     += m_msg_flits[i];
+        tot_flit_hops += m_msg_flit_hops[i];
+    }
+    printf("hist_noc_total_flits = %lld\n", tot_flits);
+    printf("hist_noc_total_flit_hops = %lld\n", tot_flit_hops);
+    printf("hist_table_energy = %.4f nJ\n", hist_ctr_TABLE_ACCESS * m_gpu->get_config().gpu_hist_access_energy / 1000.0);
+}
+
 void HIST_table::print_table( new_addr_type addr ) const
 {
     unsigned home = get_home( addr );
@@ -13,6 +13,39 @@ enum hist_request_status {
     HIST_FULL
 };
 
+// Pisacha: Sharing class of a page, used to keep private data out of HIST
+enum hist_page_class {
+    HIST_PAGE_PRIVATE,
+    HIST_PAGE_SHARED_RO,
+    HIST_PAGE_SHARED_RW
+};
+
+struct hist_page_t
+{
+    hist_page_t(){
+        m_sharer  = 0;
+        m_written = false;
+    }
+    unsigned count() const {
+        unsigned counter = 0;
+        unsigned long long tmp_sharer = m_sharer;
+
+        while( tmp_sharer > 0 ){
+            counter    = counter + ( tmp_sharer & 1 );
+            tmp_sharer = tmp_sharer >> 1;
+        }
+        return counter;
+    }
+    enum hist_page_class get_class() const {
+        if( count() <= 1 )
+            return HIST_PAGE_PRIVATE;
+        return m_written? HIST_PAGE_SHARED_RW : HIST_PAGE_SHARED_RO;
+    }
+
+    unsigned long long m_sharer;    // SMs that have touched this page
+    bool m_written;
+};
+
 struct hist_entry_t
 {
     hist_entry_t(){
@@ -23,6 +56,8 @@ struct hist_entry_t
         m_alloc_time       = 0;
         m_fill_time        = 0;
         m_last_access_time = 0;
+        m_atomic_free_time = 0;
+        m_epoch            = 0;
     }
     void allocate( unsigned key, unsigned time){
         m_status = HIST_WAIT;
@@ -56,14 +91,69 @@ struct hist_entry_t
     unsigned m_alloc_time;
     unsigned m_last_access_time;
     unsigned m_fill_time;
+
+    // For near-data atomics, atomics to one entry are serialized
+    unsigned m_atomic_free_time;
+
+    // Kernel epoch of the last touch, see HIST_table::live()
+    unsigned m_epoch;
+
+    // Per SM, cycle its HI bit was last set; older eviction notices are stale
+    unsigned *m_add_time;
     
     std::list<mem_fetch*> *filtered_mf;
 };
 
+// Pisacha: What happens to HIST entries at a kernel boundary
+enum hist_boundary_policy {
+    HIST_BOUNDARY_RETAIN = 0,   // keep everything (original behaviour)
+    HIST_BOUNDARY_FLUSH,        // drop every READY entry
+    HIST_BOUNDARY_AGE           // drop READY entries untouched for m_hist_boundary_age kernels
+};
+
+// Pisacha: HIST NoC message types, for traffic and energy accounting
+enum hist_msg_type {
+    HIST_MSG_PROBE,     // requester -> home, control
+    HIST_MSG_FORWARD,   // data forwarded to a requester
+    HIST_MSG_NACK,      // stale sharer round trip, control
+    HIST_MSG_INV,       // write notice and invalidations, control
+    HIST_MSG_EVICT,     // eviction notification, control
+    HIST_MSG_ATOMIC,    // near-data atomic request and reply, data
+    N_HIST_MSG_TYPE
+};
+
+// Pisacha: Control message in flight between SMs (invalidation from a home,
+//          eviction notification to a home). m_core is the sending SM and
+//          m_time the cycle of the eviction.
+struct hist_msg_t
+{
+    hist_msg_t( int core, new_addr_type addr, unsigned wait, unsigned time ){
+        m_core = core;
+        m_addr = addr;
+        m_wait = wait;
+        m_time = time;
+    }
+    int m_core;
+    new_addr_type m_addr;
+    unsigned m_wait;
+    unsigned m_time;
+};
+
+// Pisacha: Request parked at its home after HIST_FULL, waiting for a free entry
+struct hist_retry_t
+{
+    hist_retry_t( mem_fetch *mf ){
+        m_mf   = mf;
+        m_wait = 0;
+    }
+    mem_fetch *m_mf;
+    unsigned m_wait;
+};
+
 class HIST_table {
 public:
     HIST_table( unsigned set, unsigned assoc, unsigned range, unsigned delay, unsigned age, unsigned n_sm, cache_config &config, gpgpu_sim *gpu );
-    ~HIST_table(){}
+    ~HIST_table();
 
     // Functions
     void print_config() const;
@@ -80,13 +170,31 @@ public:
 
     enum hist_request_status probe( new_addr_type addr) const;
     enum hist_request_status probe( new_addr_type addr, unsigned &idx) const;    
+    enum hist_request_status lookup( new_addr_type addr, unsigned &idx) const;
+    bool tracked( new_addr_type addr ) const;
 //    int hist_distance(int miss_core_id, new_addr_type addr) const;
 //    int hist_abDistance(int miss_core_id, new_addr_type addr) const;
 
     bool check_in_range( int miss_SM, int home ) const;
     void allocate( int miss_core_id, new_addr_type addr, unsigned time );
     void add( int miss_core_id, new_addr_type addr, unsigned time );
-    void del( int miss_core_id, new_addr_type addr );
+    void del( int miss_core_id, new_addr_type addr, unsigned evict_time );
+    void evict( int core_id, new_addr_type addr, int type_id );
+    void flush_sm( int core_id );
+    bool flush_batched() const { return m_hist_boundary == HIST_BOUNDARY_FLUSH; }
+    bool is_sharer( const hist_entry_t &line, unsigned SM ) const {
+        return ( line.m_HI & ( 1ULL << SM ) ) && line.m_add_time[SM] >= m_flush_time[SM];
+    }
+    void send_evict( int core_id );
+    int forward_sharer( int miss_core_id, unsigned idx, new_addr_type addr ) const;
+    bool stale_forward( int miss_core_id, mem_fetch *mf );
+    void write( int write_core_id, new_addr_type addr, unsigned time );
+    bool atomic_enabled() const { return m_hist_atomic; }
+    bool atomic( int core_id, mem_fetch *mf, unsigned time );
+    void print_stale_stats() const;
+    void print_retry_stats() const;
+    void noc_traffic( enum hist_msg_type type, int src, int dst, unsigned size );
+    void print_noc_stats() const;
     void ready( int miss_core_id, new_addr_type addr, unsigned time );
     void refresh( int miss_core_id, new_addr_type addr, unsigned time );
     
@@ -94,8 +202,26 @@ public:
     void add_mf( int miss_core_id, new_addr_type addr, mem_fetch *mf );
     void fill_wait( int miss_core_id, new_addr_type addr );
     
+    // Kernel lifecycle
+    void kernel_launch();
+    void kernel_finish();
+    void save_state( FILE *fp ) const;
+    void load_state( FILE *fp );
+    bool live( const hist_entry_t &line ) const {
+        return line.m_status != HIST_READY || m_epoch - line.m_epoch <= m_epoch_keep;
+    }
+
     void recv_cycle( int core_id );
     void process_probe( int miss_core_id, mem_fetch *mf );
+    void retry_cycle( int home );
+    void coalesce( int home, new_addr_type addr );
+
+    // Page sharing classifier
+    bool page_filter_enabled() const { return m_hist_page_sz > 0; }
+    new_addr_type get_page( new_addr_type addr ) const;
+    enum hist_page_class page_access( int core_id, new_addr_type addr, bool write );
+    bool bypass( int core_id, mem_fetch *mf );
+    void print_page_stats() const;
 
     // Variable
     unsigned const m_hist_nset;
@@ -107,12 +233,40 @@ public:
 
     unsigned const m_line_sz;
     unsigned const m_line_sz_log2;
+    unsigned const m_hist_page_sz;
+    bool const m_hist_atomic;
+    unsigned const m_hist_atomic_lat;
+    bool const m_hist_evict_notify;
+    unsigned const m_hist_evict_batch;
+    unsigned const m_hist_retry_size;
+    unsigned const m_hist_retry_wait;
+    bool const m_hist_coalesce;
+    unsigned const m_flit_size;
+    unsigned const m_hist_boundary;
+    unsigned const m_hist_boundary_age;
 protected:
+    unsigned m_epoch;       // bumped at each kernel boundary that is not RETAIN
+    unsigned m_epoch_keep;  // READY entries older than this many epochs are dead
     unsigned n_sm_sqrt;
     cache_config &m_cache_config;
     gpgpu_sim *m_gpu;
     
     hist_entry_t **m_hist_table;
+    unsigned *m_flush_time;     // per SM: sharer bits added before this are gone
     std::list<mem_fetch*> *recv_mf;
     std::list<mem_fetch*> *srcn_mf;
+    std::list<hist_msg_t> *inv_msg;
+    std::list<hist_msg_t> *evict_buf;
+    std::list<hist_msg_t> *evict_msg;
+    std::list<mem_fetch*> *nack_mf;
+    std::list<hist_retry_t> *retry_mf;
+    std::list<mem_fetch*> *atom_mf;
+    tr1_hash_map<mem_fetch*,int> m_fwd_sharer;  // sharer each in-flight forward is served by
+
+    unsigned long long m_msg_count[N_HIST_MSG_TYPE];
+    unsigned long long m_msg_flits[N_HIST_MSG_TYPE];
+    unsigned long long m_msg_flit_hops[N_HIST_MSG_TYPE];
+
+    typedef tr1_hash_map<new_addr_type,hist_page_t> page_table_t;
+    page_table_t m_page_table;
 };
@@ -27,9 +27,15 @@
 
 #include "gpu-sim.h"
 #include "stat-tool.h"
+#include "../cuda-sim/memory.h"
 #include <assert.h>
+#include <string.h>
 
 #define MAX_DEFAULT_CACHE_SIZE_MULTIBLIER 4
+#define DRRIP_PSEL_MAX ((1U << 10) - 1)     // 10-bit policy selector
+#define BRRIP_LONG_INTERVAL 32
+#define BDI_MAX_LINE 256                    // largest line the compressor reads
+#define BDI_SEGMENT 8                       // compressed lines take whole segments
 // used to allocate memory that is large enough to adapt the changes in cache size across kernels
 
 const char * cache_request_status_str(enum cache_request_status status) 
@@ -81,7 +87,7 @@ unsigned l1d_cache_config::set_index(new_addr_type addr) const{
         break;
 
     case CUSTOM_SET_FUNCTION:
-        /* No custom set function implemented */
+        set_index = m_set_hash.index(addr);
         break;
 
     case LINEAR_SET_FUNCTION:
@@ -89,9 +95,8 @@ unsigned l1d_cache_config::set_index(new_addr_type addr) const{
         break;
     }
 
-    // Linear function selected or custom set index function not implemented
     assert((set_index < m_nset) && "\nError: Set index out of bounds. This is caused by "
-            "an incorrect or unimplemented custom set index function.\n");
+            "an incorrect custom set index function.\n");
 
     return set_index;
 }
@@ -103,32 +108,242 @@ void l2_cache_config::init(linear_to_raw_address_translation *address_mapping){
 
 unsigned l2_cache_config::set_index(new_addr_type addr) const{
 	if(!m_address_mapping){
+		if(m_set_index_function == CUSTOM_SET_FUNCTION)
+			return m_set_hash.index(addr);
 		return(addr >> m_line_sz_log2) & (m_nset-1);
 	}else{
 		// Calculate set index without memory partition bits to reduce set camping
 		new_addr_type part_addr = m_address_mapping->partition_address(addr);
+		if(m_set_index_function == CUSTOM_SET_FUNCTION)
+			return m_set_hash.index(part_addr);
 		return(part_addr >> m_line_sz_log2) & (m_nset -1);
 	}
 }
 
-tag_array::~tag_array() 
+/****************************************************************** Set index hashes ******************************************************************/
+
+// The custom set index function is picked by name from this registry. Each
+// entry parses its arguments (the text after ':') into the hash; index()
+// then dispatches on the kind.
+
+static bool parse_set_hash_list( const char *args, std::vector<unsigned long long> &out )
 {
-    delete[] m_lines;
+    if (args == NULL || *args == '\0') 
+        return false;
+    const char *p = args;
+    while (*p) {
+        char *end;
+        unsigned long long v = strtoull(p, &end, 0);
+        if (end == p) 
+            return false;
+        out.push_back(v);
+        p = end;
+        if (*p == ',') 
+            p++;
+        else if (*p != '\0') 
+            return false;
+    }
+    return true;
 }
 
-tag_array::tag_array( cache_config &config,
-                      int core_id,
-                      int type_id,
-                      cache_block_t* new_lines, gpgpu_sim *gpu)
-    : m_config( config ),
-      m_lines( new_lines ), gpu_root( gpu )
+static bool set_hash_parse_none( const char *args, std::vector<unsigned long long> &out )
 {
-    init( core_id, type_id );
+    return args == NULL;
+}
+
+struct set_hash_registry_entry {
+    const char *name;
+    enum set_hash_kind kind;
+    bool pow2_sets;         // needs a power-of-two number of sets
+    bool (*parse)( const char *args, std::vector<unsigned long long> &out );
+};
+
+static const set_hash_registry_entry set_hash_registry[] = {
+    { "xor",    XOR_FOLD_HASH,          true,  set_hash_parse_none },
+    { "prime",  PRIME_MODULO_HASH,      false, set_hash_parse_none },
+    { "perm",   BIT_PERMUTATION_HASH,   true,  parse_set_hash_list },
+    { "matrix", XOR_MATRIX_HASH,        true,  parse_set_hash_list },
+};
+
+bool set_index_hash::init( const char *spec, unsigned nset, unsigned line_sz_log2 )
+{
+    const char *colon = strchr(spec, ':');
+    size_t name_len = colon? (size_t)(colon - spec) : strlen(spec);
+    const char *args = colon? colon + 1 : NULL;
+
+    const set_hash_registry_entry *entry = NULL;
+    for (unsigned i = 0; i < sizeof(set_hash_registry) / sizeof(set_hash_registry[0]); i++) {
+        if (strlen(set_hash_registry[i].name) == name_len && strncmp(set_hash_registry[i].name, spec, name_len) == 0) 
+            entry = &set_hash_registry[i];
+    }
+    if (entry == NULL || nset == 0) 
+        return false;
+    if (entry->pow2_sets && (nset & (nset - 1)) != 0) 
+        return false;
+
+    std::vector<unsigned long long> values;
+    if (!entry->parse(args, values)) 
+        return false;
+
+    m_kind = entry->kind;
+    m_nset = nset;
+    m_nset_log2 = LOGB2(nset);
+    m_line_sz_log2 = line_sz_log2;
+    m_bits.clear();
+    m_masks.clear();
+
+    switch (m_kind) {
+    case XOR_FOLD_HASH:
+        break;
+    case PRIME_MODULO_HASH:
+        // largest prime <= nset; the sets above it are never indexed
+        for (m_prime = nset; m_prime > 2; m_prime--) {
+            bool prime = true;
+            for (unsigned d = 2; d * d <= m_prime && prime; d++) 
+                prime = (m_prime % d) != 0;
+            if (prime) 
+                break;
+        }
+        break;
+    case BIT_PERMUTATION_HASH:
+        if (values.size() != m_nset_log2) 
+            return false;
+        for (unsigned i = 0; i < values.size(); i++) {
+            if (values[i] >= 8 * sizeof(new_addr_type)) 
+                return false;
+            m_bits.push_back(values[i]);
+        }
+        break;
+    case XOR_MATRIX_HASH:
+        if (values.size() != m_nset_log2) 
+            return false;
+        for (unsigned i = 0; i < values.size(); i++) 
+            m_masks.push_back(values[i]);
+        break;
+    }
+    return true;
+}
+
+unsigned set_index_hash::index( new_addr_type addr ) const
+{
+    new_addr_type block = addr >> m_line_sz_log2;
+    unsigned set = 0;
+    switch (m_kind) {
+    case XOR_FOLD_HASH:
+        if (m_nset_log2 == 0) 
+            return 0;
+        while (block) {
+            set ^= block & (m_nset - 1);
+            block >>= m_nset_log2;
+        }
+        break;
+    case PRIME_MODULO_HASH:
+        set = block % m_prime;
+        break;
+    case BIT_PERMUTATION_HASH:
+        for (unsigned i = 0; i < m_bits.size(); i++) 
+            set |= ((addr >> m_bits[i]) & 1) << i;
+        break;
+    case XOR_MATRIX_HASH:
+        for (unsigned i = 0; i < m_masks.size(); i++) 
+            set |= __builtin_parityll(addr & m_masks[i]) << i;
+        break;
+    }
+    assert(set < m_nset);
+    return set;
+}
+
+tag_array::~tag_array() 
+{
+    delete[] m_tag;
+    delete[] m_status;
+    delete[] m_last_access_time;
+    delete[] m_alloc_time;
+    delete[] m_rrpv;
+    delete[] m_sector_valid;
+    delete[] m_sector_dirty;
+    delete[] m_sector_pending;
+    delete[] m_sector_used;
+    delete[] m_sector_fetch;
+    delete[] m_sig;
+    delete[] m_reused;
+    delete[] m_pred_dead;
+    delete[] m_prefetched;
+    delete[] m_comp_size;
 }
 
 void tag_array::update_cache_parameters(cache_config &config)
 {
 	m_config=config;
+	// the tree shape depends on the associativity
+	m_plru.assign( m_plru.size(), 0 );
+}
+
+void tag_array::save_state( FILE *fp ) const
+{
+    unsigned n = m_config.get_num_lines();
+    ckpt_write( fp, n );
+    for (unsigned i=0; i < n; i++) {
+        unsigned status = m_status[i];
+        ckpt_write( fp, m_tag[i] );
+        ckpt_write( fp, m_alloc_time[i] );
+        ckpt_write( fp, m_last_access_time[i] );
+        ckpt_write( fp, m_rrpv[i] );
+        ckpt_write( fp, status );
+        ckpt_write( fp, m_sector_valid[i] );
+        ckpt_write( fp, m_sector_dirty[i] );
+        ckpt_write( fp, m_sector_used[i] );
+    }
+    for (unsigned s=0; s < m_config.m_nset; s++) 
+        ckpt_write( fp, m_plru[s] );
+    ckpt_write( fp, m_psel );
+    ckpt_write( fp, m_brrip_count );
+    unsigned compressed = ( m_comp_size != NULL );
+    ckpt_write( fp, compressed );
+    if ( m_comp_size ) {
+        for (unsigned i=0; i < n; i++) 
+            ckpt_write( fp, m_comp_size[i] );
+    }
+}
+
+/// Lines still RESERVED lost their fill with the MSHRs and come back INVALID,
+/// and so do pending sectors of a valid line
+void tag_array::load_state( FILE *fp )
+{
+    unsigned n;
+    ckpt_read( fp, n );
+    if ( n != m_config.get_num_lines() ) {
+        printf("GPGPU-Sim: checkpoint has %u lines for a %u line cache\n", n, m_config.get_num_lines());
+        abort();
+    }
+    for (unsigned i=0; i < n; i++) {
+        unsigned status;
+        ckpt_read( fp, m_tag[i] );
+        ckpt_read( fp, m_alloc_time[i] );
+        ckpt_read( fp, m_last_access_time[i] );
+        ckpt_read( fp, m_rrpv[i] );
+        ckpt_read( fp, status );
+        ckpt_read( fp, m_sector_valid[i] );
+        ckpt_read( fp, m_sector_dirty[i] );
+        ckpt_read( fp, m_sector_used[i] );
+        m_status[i] = (status == RESERVED)? INVALID : (enum cache_block_state)status;
+        m_sector_pending[i] = 0;
+    }
+    for (unsigned s=0; s < m_config.m_nset; s++) 
+        ckpt_read( fp, m_plru[s] );
+    ckpt_read( fp, m_psel );
+    ckpt_read( fp, m_brrip_count );
+    unsigned compressed;
+    ckpt_read( fp, compressed );
+    if ( compressed != ( m_comp_size != NULL ) ) {
+        printf("GPGPU-Sim: checkpoint cache is %scompressed, configured cache is %scompressed\n", 
+               compressed? "" : "not ", m_comp_size? "" : "not ");
+        abort();
+    }
+    if ( m_comp_size ) {
+        for (unsigned i=0; i < n; i++) 
+            ckpt_read( fp, m_comp_size[i] );
+    }
 }
 
 tag_array::tag_array( cache_config &config,
@@ -137,7 +352,46 @@ tag_array::tag_array( cache_config &config,
     : m_config( config ), gpu_root( gpu )
 {
     //assert( m_config.m_write_policy == READ_ONLY ); Old assert
-    m_lines = new cache_block_t[MAX_DEFAULT_CACHE_SIZE_MULTIBLIER*config.get_num_lines()];
+    unsigned n_lines = MAX_DEFAULT_CACHE_SIZE_MULTIBLIER*config.get_num_lines();
+    m_tag = new new_addr_type[n_lines];
+    m_status = new cache_block_state[n_lines];
+    m_last_access_time = new unsigned[n_lines];
+    m_alloc_time = new unsigned[n_lines];
+    m_rrpv = new unsigned char[n_lines];
+    m_sector_valid = new unsigned char[n_lines];
+    m_sector_dirty = new unsigned char[n_lines];
+    m_sector_pending = new unsigned char[n_lines];
+    m_sector_used = new unsigned char[n_lines];
+    m_sector_fetch = new unsigned char[n_lines*MAX_CACHE_SECTORS];
+    for (unsigned i=0; i < n_lines; i++) {
+        m_tag[i] = 0;
+        m_status[i] = INVALID;
+        m_last_access_time[i] = 0;
+        m_alloc_time[i] = 0;
+        m_rrpv[i] = 0;
+        m_sector_valid[i] = 0;
+        m_sector_dirty[i] = 0;
+        m_sector_pending[i] = 0;
+        m_sector_used[i] = 0;
+    }
+    for (unsigned i=0; i < n_lines*MAX_CACHE_SECTORS; i++) 
+        m_sector_fetch[i] = 0;
+    m_plru.assign( MAX_DEFAULT_CACHE_SIZE_MULTIBLIER*config.m_nset, 0 );
+    m_set_accesses.assign( MAX_DEFAULT_CACHE_SIZE_MULTIBLIER*config.m_nset, 0 );
+    m_psel = DRRIP_PSEL_MAX / 2;
+    m_brrip_count = 0;
+    m_bypass_pred = NULL;
+    m_sig = NULL;
+    m_reused = NULL;
+    m_pred_dead = NULL;
+    m_victim = NULL;
+    m_prefetched = NULL;
+    m_comp_size = NULL;
+    if ( config.compressed() ) {
+        m_comp_size = new unsigned short[n_lines];
+        for (unsigned i=0; i < n_lines; i++) 
+            m_comp_size[i] = config.get_line_sz();
+    }
     init( core_id, type_id );
 }
 
@@ -147,6 +401,11 @@ void tag_array::init( int core_id, int type_id )
     m_miss = 0;
     m_pending_hit = 0;
     m_res_fail = 0;
+    m_fetched_bytes = 0;
+    m_used_bytes = 0;
+    m_comp_raw_bytes = 0;
+    m_comp_bytes = 0;
+    m_decompressions = 0;
     // initialize snapshot counters for visualizer
     m_prev_snapshot_access = 0;
     m_prev_snapshot_miss = 0;
@@ -155,59 +414,215 @@ void tag_array::init( int core_id, int type_id )
     m_type_id = type_id;
 }
 
+void tag_array::set_bypass_predictor( l1d_bypass_predictor *pred )
+{
+    unsigned n_lines = MAX_DEFAULT_CACHE_SIZE_MULTIBLIER*m_config.get_num_lines();
+    assert( m_bypass_pred == NULL );
+    m_bypass_pred = pred;
+    m_sig = new unsigned[n_lines];
+    m_reused = new bool[n_lines];
+    m_pred_dead = new bool[n_lines];
+    for (unsigned i=0; i < n_lines; i++) {
+        m_sig[i] = (unsigned)-1;
+        m_reused[i] = false;
+        m_pred_dead[i] = false;
+    }
+}
+
+void tag_array::set_signature( unsigned idx, unsigned sig, bool predicted_dead )
+{
+    if ( m_bypass_pred == NULL ) 
+        return;
+    m_sig[idx] = sig;
+    m_pred_dead[idx] = predicted_dead;
+}
+
+/// The line in idx leaves the cache: train the bypass predictor and the
+/// prefetch stats on what became of it
+void tag_array::evict_line( unsigned idx )
+{
+    if ( m_bypass_pred ) {
+        // tell the predictor whether the line was reused
+        if ( m_status[idx] != INVALID && m_sig[idx] != (unsigned)-1 ) 
+            m_bypass_pred->train( m_sig[idx], m_reused[idx], m_pred_dead[idx] );
+        m_sig[idx] = (unsigned)-1;
+        m_reused[idx] = false;
+    }
+    if ( m_prefetched ) {
+        // a prefetched line leaves without ever being read
+        if ( m_prefetched[idx] && m_status[idx] != INVALID ) 
+            l1d_pf_ctr_UNUSED++;
+        m_prefetched[idx] = false;
+    }
+}
+
+/// mf is the request the line is brought in for, NULL if there is none
+void tag_array::allocate_line( unsigned idx, new_addr_type tag, unsigned time, const mem_fetch *mf )
+{
+    if ( rrip() && m_status[idx] != INVALID ) 
+        rrip_age( idx );
+    evict_line( idx );
+    if ( m_victim ) {
+        // the previous line moves to the victim cache and the new one leaves it
+        new_addr_type dropped;
+        if ( (m_status[idx] == VALID || m_status[idx] == MODIFIED) 
+             && m_victim->insert( m_tag[idx], m_sector_valid[idx], m_sector_used[idx], dropped ) ) {
+            l1d_vc_ctr_DROP++;
+            if( gpu_root )
+                gpu_root->m_hist->evict( m_core_id, dropped, m_type_id );
+        }
+        m_victim->remove( tag );
+    }
+    m_tag[idx] = tag;
+    m_status[idx] = RESERVED;
+    m_alloc_time[idx] = time;
+    m_last_access_time[idx] = time;
+    m_sector_valid[idx] = 0;
+    m_sector_dirty[idx] = 0;
+    m_sector_pending[idx] = 0;
+    m_sector_used[idx] = 0;
+    insert( idx );
+    if ( m_comp_size ) {
+        m_comp_size[idx] = compressed_size( tag, mf );
+        m_comp_raw_bytes += m_config.get_line_sz();
+        m_comp_bytes += m_comp_size[idx];
+        make_room( idx );
+    }
+}
+
+/// Fetched sectors arrived. An unsectored line is always filled whole.
+void tag_array::fill_line( unsigned idx, unsigned sectors )
+{
+    if ( !m_config.sectored() ) 
+        sectors = m_config.full_sector_mask();
+    assert( m_status[idx] == RESERVED || (m_config.sectored() && m_status[idx] != INVALID) );
+    m_sector_valid[idx] |= sectors;
+    m_sector_pending[idx] &= ~sectors;
+    m_fetched_bytes += m_config.sector_bytes( sectors );
+    if ( m_status[idx] == RESERVED ) 
+        m_status[idx] = VALID;
+}
+
+void tag_array::mark_used( unsigned idx, unsigned sectors )
+{
+    m_used_bytes += m_config.sector_bytes( sectors & ~m_sector_used[idx] );
+    m_sector_used[idx] |= sectors;
+}
+
+void tag_array::mark_dirty( unsigned idx, unsigned sectors )
+{
+    m_status[idx] = MODIFIED;
+    m_sector_dirty[idx] |= m_config.sectored()? sectors : m_config.full_sector_mask();
+}
+
+/// Write-evict: drop the written sectors. The line is invalid once nothing is
+/// left in it or on its way to it.
+void tag_array::invalidate_sectors( unsigned idx, unsigned sectors )
+{
+    if ( !m_config.sectored() ) 
+        sectors = m_config.full_sector_mask();
+    m_sector_valid[idx] &= ~sectors;
+    m_sector_dirty[idx] &= ~sectors;
+    if ( m_status[idx] == MODIFIED && m_sector_dirty[idx] == 0 ) 
+        m_status[idx] = VALID;
+    if ( m_sector_valid[idx] == 0 && m_sector_pending[idx] == 0 ) 
+        m_status[idx] = INVALID;
+}
+
+static unsigned first_sector( unsigned mask )
+{
+    assert( mask != 0 );
+    unsigned s = 0;
+    while ( !((mask >> s) & 1) ) 
+        s++;
+    return s;
+}
+
+/// Sectors from the first to the last one of mask
+static unsigned sector_span( unsigned mask )
+{
+    assert( mask != 0 );
+    unsigned last = first_sector( mask );
+    while ( mask >> (last+1) ) 
+        last++;
+    return ((1U << (last+1)) - 1) & ~((1U << first_sector(mask)) - 1);
+}
+
+/// Line allocated to addr, or (unsigned)-1
+unsigned tag_array::lookup( new_addr_type addr ) const
+{
+    unsigned set_index = m_config.set_index(addr);
+    new_addr_type tag = m_config.tag(addr);
+    unsigned first = set_index*m_config.m_assoc;
+    unsigned last = first + m_config.m_assoc;
+
+    // tags and status only
+    for (unsigned index=first; index<last; index++) {
+        if ( m_tag[index] == tag && m_status[index] != INVALID ) 
+            return index;
+    }
+    return (unsigned)-1;
+}
+
 enum cache_request_status tag_array::probe( new_addr_type addr, unsigned &idx ) const {
+    return probe( addr, idx, m_config.full_sector_mask() );
+}
+
+enum cache_request_status tag_array::probe( new_addr_type addr, unsigned &idx, unsigned sectors ) const {
     //assert( m_config.m_write_policy == READ_ONLY );
     unsigned set_index = m_config.set_index(addr);
-    new_addr_type tag = m_config.tag(addr);
 
     unsigned invalid_line = (unsigned)-1;
     unsigned valid_line = (unsigned)-1;
-    unsigned valid_timestamp = (unsigned)-1;
 
     bool all_reserved = true;
+    unsigned first = set_index*m_config.m_assoc;
+    unsigned last = first + m_config.m_assoc;
 
     // check for hit or pending hit
-    for (unsigned way=0; way<m_config.m_assoc; way++) {
-        unsigned index = set_index*m_config.m_assoc+way;
-        cache_block_t *line = &m_lines[index];
-        if (line->m_tag == tag) {
-            if ( line->m_status == RESERVED ) {
-                idx = index;
-                return HIT_RESERVED;
-            } else if ( line->m_status == VALID ) {
-                idx = index;
-                return HIT;
-            } else if ( line->m_status == MODIFIED ) {
-                idx = index;
-                return HIT;
-            } else {
-                assert( line->m_status == INVALID );
+    unsigned line = lookup( addr );
+    if ( line != (unsigned)-1 ) {
+        idx = line;
+        if ( !m_config.sectored() ) 
+            return ( m_status[line] == RESERVED )? HIT_RESERVED : HIT;
+        unsigned missing = sectors & ~m_sector_valid[line];
+        if ( missing == 0 ) 
+            return HIT;
+        unsigned pending = missing & m_sector_pending[line];
+        if ( pending == 0 ) 
+            return MISS; // fetch the missing sectors into this line
+        if ( pending == missing ) {
+            // merge if a single fetch brings in all of them
+            const unsigned char *fetch = m_sector_fetch + line*MAX_CACHE_SECTORS;
+            unsigned f = fetch[first_sector(missing)];
+            bool one_fetch = true;
+            for (unsigned s=0; s < m_config.get_num_sectors(); s++) {
+                if ( ((missing >> s) & 1) && fetch[s] != f ) 
+                    one_fetch = false;
             }
+            if ( one_fetch ) 
+                return HIT_RESERVED;
         }
-        if (line->m_status != RESERVED) {
+        // needs more than one fetch: retry once the pending sectors arrive
+        return RESERVATION_FAIL;
+    }
+
+    // miss: pick a replacement candidate
+    for (unsigned index=first; index<last; index++) {
+        if ( !reserved(index) ) {
             all_reserved = false;
-            if (line->m_status == INVALID) {
+            if (m_status[index] == INVALID) 
                 invalid_line = index;
-            } else {
-                // valid line : keep track of most appropriate replacement candidate
-                if ( m_config.m_replacement_policy == LRU ) {
-                    if ( line->m_last_access_time < valid_timestamp ) {
-                        valid_timestamp = line->m_last_access_time;
-                        valid_line = index;
-                    }
-                } else if ( m_config.m_replacement_policy == FIFO ) {
-                    if ( line->m_alloc_time < valid_timestamp ) {
-                        valid_timestamp = line->m_alloc_time;
-                        valid_line = index;
-                    }
-                }
-            }
         }
     }
+    if ( !all_reserved && invalid_line == (unsigned)-1 ) 
+        valid_line = victim( set_index );
     if ( all_reserved ) {
         assert( m_config.m_alloc_policy == ON_MISS ); 
         return RESERVATION_FAIL; // miss and not enough space in cache to allocate on miss
     }
+    if ( m_comp_size && set_bytes(set_index, true) + m_config.get_line_sz() > m_config.get_set_bytes() ) 
+        return RESERVATION_FAIL; // the lines waiting for fills leave no room for an incompressible one
 
     if ( invalid_line != (unsigned)-1 ) {
         idx = invalid_line;
@@ -218,37 +633,171 @@ enum cache_request_status tag_array::probe( new_addr_type addr, unsigned &idx )
     return MISS;
 }
 
-enum cache_request_status tag_array::access( new_addr_type addr, unsigned time, unsigned &idx )
+/// Replacement candidate among the valid, non-reserved lines of a set
+unsigned tag_array::victim( unsigned set_index ) const
+{
+    unsigned first = set_index*m_config.m_assoc;
+    unsigned last = first + m_config.m_assoc;
+    unsigned valid_line = (unsigned)-1;
+
+    switch ( m_config.m_replacement_policy ) {
+    case LRU:
+    case FIFO: {
+        const unsigned *stamp = ( m_config.m_replacement_policy == FIFO )? m_alloc_time : m_last_access_time;
+        unsigned valid_timestamp = (unsigned)-1;
+        for (unsigned index=first; index<last; index++) {
+            if ( !reserved(index) && stamp[index] < valid_timestamp ) {
+                valid_timestamp = stamp[index];
+                valid_line = index;
+            }
+        }
+        break;
+    }
+    case SRRIP:
+    case BRRIP:
+    case DRRIP: {
+        // the line predicted to be re-referenced furthest away. Aging the rest
+        // of the set until it reaches the maximum is done in allocate_line()
+        int furthest = -1;
+        for (unsigned index=first; index<last; index++) {
+            if ( !reserved(index) && (int)m_rrpv[index] > furthest ) {
+                furthest = m_rrpv[index];
+                valid_line = index;
+            }
+        }
+        break;
+    }
+    case PLRU: {
+        unsigned long long bits = m_plru[set_index];
+        unsigned node = 1;
+        while ( node < m_config.m_assoc ) 
+            node = 2*node + ((bits >> node) & 1);
+        valid_line = first + node - m_config.m_assoc;
+        if ( reserved(valid_line) ) {
+            // the tree points at a line waiting for its fill
+            for (unsigned index=first; index<last; index++) {
+                if ( !reserved(index) ) {
+                    valid_line = index;
+                    break;
+                }
+            }
+        }
+        break;
+    }
+    }
+    return valid_line;
+}
+
+/// Hit on a line
+void tag_array::touch( unsigned idx )
+{
+    if ( rrip() ) {
+        m_rrpv[idx] = 0;
+    } else if ( m_config.m_replacement_policy == PLRU ) {
+        // point every node on the path away from this way
+        unsigned long long &bits = m_plru[idx / m_config.m_assoc];
+        for (unsigned node = m_config.m_assoc + idx % m_config.m_assoc; node > 1; node /= 2) {
+            if ( node & 1 ) 
+                bits &= ~(1ULL << (node/2));
+            else
+                bits |= 1ULL << (node/2);
+        }
+    }
+}
+
+/// New line allocated
+void tag_array::insert( unsigned idx )
+{
+    if ( m_config.m_replacement_policy == PLRU ) {
+        touch( idx );
+        return;
+    }
+    if ( !rrip() ) 
+        return;
+    enum replacement_policy_t policy = m_config.m_replacement_policy;
+    if ( policy == DRRIP ) 
+        policy = duel( idx / m_config.m_assoc );
+    if ( policy == BRRIP && ++m_brrip_count % BRRIP_LONG_INTERVAL != 0 ) 
+        m_rrpv[idx] = rrpv_max();
+    else
+        m_rrpv[idx] = rrpv_max() - 1;
+}
+
+/// The victim at idx had to reach the maximum RRPV: age the rest of its set
+/// by the same amount
+void tag_array::rrip_age( unsigned idx )
+{
+    unsigned first = (idx / m_config.m_assoc) * m_config.m_assoc;
+    unsigned age = rrpv_max() - m_rrpv[idx];
+    if ( age == 0 ) 
+        return;
+    for (unsigned index=first; index<first+m_config.m_assoc; index++) {
+        if ( index != idx ) 
+            m_rrpv[index] = ( m_rrpv[index] + age > rrpv_max() )? rrpv_max() : m_rrpv[index] + age;
+    }
+}
+
+/// DRRIP: leader sets always use their policy and a miss in one of them moves
+/// the selector away from it. Every other set follows the selector.
+enum replacement_policy_t tag_array::duel( unsigned set_index )
+{
+    unsigned stride = m_config.m_dueling_sets? m_config.m_nset / m_config.m_dueling_sets : 0;
+    if ( stride >= 2 ) {
+        if ( set_index % stride == 0 ) {
+            if ( m_psel < DRRIP_PSEL_MAX ) 
+                m_psel++;
+            return SRRIP;
+        }
+        if ( set_index % stride == stride - 1 ) {
+            if ( m_psel > 0 ) 
+                m_psel--;
+            return BRRIP;
+        }
+    }
+    return ( m_psel > DRRIP_PSEL_MAX / 2 )? BRRIP : SRRIP;
+}
+
+enum cache_request_status tag_array::access( new_addr_type addr, unsigned time, unsigned &idx, const mem_fetch *mf )
 {
     bool wb=false;
     cache_block_t evicted;
-    enum cache_request_status result = access(addr,time,idx,wb,evicted);
+    enum cache_request_status result = access(addr,time,idx,wb,evicted,mf);
     assert(!wb);
     return result;
 }
 
-enum cache_request_status tag_array::access( new_addr_type addr, unsigned time, unsigned &idx, bool &wb, cache_block_t &evicted ) 
+enum cache_request_status tag_array::access( new_addr_type addr, unsigned time, unsigned &idx, bool &wb, cache_block_t &evicted, const mem_fetch *mf ) 
 {
     m_access++;
+    m_set_accesses[m_config.set_index(addr)]++;
     shader_cache_access_log(m_core_id, m_type_id, 0); // log accesses to cache
-    enum cache_request_status status = probe(addr,idx);
+    unsigned sectors = m_config.sector_mask(mf);
+    enum cache_request_status status = probe(addr,idx,sectors);
     switch (status) {
     case HIT_RESERVED: 
         m_pending_hit++;
     case HIT: 
-        m_lines[idx].m_last_access_time=time; 
+        m_last_access_time[idx]=time; 
+        touch( idx );
+        if ( m_bypass_pred ) 
+            m_reused[idx] = true;
+        if ( m_prefetched && m_prefetched[idx] ) {
+            // first demand use of a prefetched line, late if still on its way
+            m_prefetched[idx] = false;
+            l1d_pf_ctr_USEFUL++;
+            if ( status == HIT_RESERVED ) 
+                l1d_pf_ctr_LATE++;
+        }
+        mark_used( idx, sectors );
         break;
     case MISS:
         m_miss++;
         shader_cache_access_log(m_core_id, m_type_id, 1); // log cache misses
         if ( m_config.m_alloc_policy == ON_MISS ) {
-            if( gpu_root )
-                gpu_root->m_hist->del( m_core_id, m_lines[idx].m_block_addr );
-            if( m_lines[idx].m_status == MODIFIED ) {
-                wb = true;
-                evicted = m_lines[idx];
-            }
-            m_lines[idx].allocate( m_config.tag(addr), m_config.block_addr(addr), time );
+            unsigned fetch = sectors;
+            fetch_addr( addr, idx, fetch );
+            reserve( addr, idx, time, fetch, wb, evicted, mf );
+            mark_used( idx, sectors );
         }
         break;
     case RESERVATION_FAIL:
@@ -263,35 +812,315 @@ enum cache_request_status tag_array::access( new_addr_type addr, unsigned time,
     return status;
 }
 
+/// Reserve idx for the fetch of the given sectors of addr: the missing sectors
+/// of a resident line, or a new line that replaces the one in idx
+void tag_array::reserve( new_addr_type addr, unsigned idx, unsigned time, unsigned fetch, bool &wb, cache_block_t &evicted, const mem_fetch *mf )
+{
+    if ( m_config.sectored() && resident(idx, addr) ) {
+        // sector miss: the line stays and only its missing sectors are read
+        m_last_access_time[idx]=time; 
+        touch( idx );
+        if ( m_bypass_pred ) 
+            m_reused[idx] = true;
+    } else {
+        if( gpu_root && !m_victim && m_status[idx] != INVALID )
+            gpu_root->m_hist->evict( m_core_id, m_tag[idx], m_type_id );
+        if( m_status[idx] == MODIFIED ) {
+            wb = true;
+            evicted.m_block_addr = m_tag[idx];
+            evicted.m_status = m_status[idx];
+            evicted.m_sector_dirty = m_sector_dirty[idx];
+        }
+        allocate_line( idx, m_config.tag(addr), time, mf );
+    }
+    if ( m_config.sectored() ) {
+        m_sector_pending[idx] |= fetch;
+        for (unsigned s=0; s < m_config.get_num_sectors(); s++) {
+            if ( (fetch >> s) & 1 ) 
+                m_sector_fetch[idx*MAX_CACHE_SECTORS + s] = first_sector( fetch );
+        }
+    }
+}
+
+/// Reserve idx for a prefetch of addr, which probed as a MISS. Unlike a demand
+/// miss this is not a cache access and leaves the line unused. Returns true,
+/// with the line it replaced, if a valid line made way for it.
+bool tag_array::prefetch( new_addr_type addr, unsigned idx, unsigned time, unsigned fetch, bool &wb, cache_block_t &evicted, new_addr_type &displaced, const mem_fetch *trigger )
+{
+    assert( m_config.m_alloc_policy == ON_MISS && m_prefetched );
+    bool replaced = !resident(idx, addr) && m_status[idx] != INVALID;
+    displaced = m_tag[idx];
+    reserve( addr, idx, time, fetch, wb, evicted, trigger );
+    m_prefetched[idx] = true;
+    return replaced;
+}
+
+void tag_array::track_prefetches()
+{
+    unsigned n_lines = MAX_DEFAULT_CACHE_SIZE_MULTIBLIER*m_config.get_num_lines();
+    assert( m_prefetched == NULL );
+    m_prefetched = new bool[n_lines];
+    for (unsigned i=0; i < n_lines; i++) 
+        m_prefetched[i] = false;
+}
+
+/// Base-Delta-Immediate: can every T sized word of the line be coded in
+/// DELTA bytes, as a delta from zero or from one base, the first word that is
+/// not itself small? Neither loop has an early exit or a data dependent branch,
+/// so that the compiler can vectorize them. The base is picked by a backward
+/// select, which leaves the first large word in it.
+template<class T, unsigned DELTA>
+static bool bdi_fits( const unsigned char *line, unsigned line_sz )
+{
+    T w[BDI_MAX_LINE / sizeof(T)];
+    unsigned n = line_sz / sizeof(T);
+    memcpy( w, line, line_sz );
+    const T bias = (T)1 << (8*DELTA - 1);
+    const T range = (T)1 << (8*DELTA);
+    T base = 0;
+    for (unsigned i=n; i > 0; i--) {
+        T large = (T)0 - (T)( (T)(w[i-1] + bias) >= range );
+        base = (w[i-1] & large) | (base & ~large);
+    }
+    unsigned bad = 0;
+    for (unsigned i=0; i < n; i++) 
+        bad |= ( (T)(w[i] + bias) >= range ) & ( (T)(w[i] - base + bias) >= range );
+    return bad == 0;
+}
+
+/// Base, deltas and one bit per word saying which base it is relative to
+static unsigned bdi_encoded_size( unsigned line_sz, unsigned base_sz, unsigned delta_sz )
+{
+    unsigned n = line_sz / base_sz;
+    return base_sz + n*delta_sz + (n+7)/8;
+}
+
+/// Smallest BDI encoding of the line, in whole segments
+static unsigned bdi_size( const unsigned char *line, unsigned line_sz )
+{
+    unsigned long long w[BDI_MAX_LINE / 8];
+    unsigned n = line_sz / 8;
+    memcpy( w, line, line_sz );
+    unsigned long long nonzero = 0, differ = 0;
+    for (unsigned i=0; i < n; i++) {
+        nonzero |= w[i];
+        differ |= w[i] ^ w[0];
+    }
+    unsigned size = line_sz;
+    if ( nonzero == 0 ) 
+        size = 1;
+    else if ( differ == 0 ) 
+        size = 8;
+    else {
+        if ( bdi_fits<unsigned long long,1>(line, line_sz) ) 
+            size = std::min( size, bdi_encoded_size(line_sz, 8, 1) );
+        else if ( bdi_fits<unsigned long long,2>(line, line_sz) ) 
+            size = std::min( size, bdi_encoded_size(line_sz, 8, 2) );
+        else if ( bdi_fits<unsigned long long,4>(line, line_sz) ) 
+            size = std::min( size, bdi_encoded_size(line_sz, 8, 4) );
+        if ( bdi_fits<unsigned,1>(line, line_sz) ) 
+            size = std::min( size, bdi_encoded_size(line_sz, 4, 1) );
+        else if ( bdi_fits<unsigned,2>(line, line_sz) ) 
+            size = std::min( size, bdi_encoded_size(line_sz, 4, 2) );
+        if ( bdi_fits<unsigned short,1>(line, line_sz) ) 
+            size = std::min( size, bdi_encoded_size(line_sz, 2, 1) );
+    }
+    size = (size + BDI_SEGMENT-1) / BDI_SEGMENT * BDI_SEGMENT;
+    return std::min( size, line_sz );
+}
+
+/// Compressed size of the functional contents of the line. Data is read when
+/// the line is allocated and the size is kept until it leaves, even if it is
+/// written in the meantime. Only global data can be read from g_cache_data:
+/// local, constant, texture and instruction lines, and lines allocated
+/// without a request (mf NULL), are stored uncompressed. So are lines a
+/// write-allocate read brings in, since its type does not say whether the
+/// store that missed was global or local.
+unsigned tag_array::compressed_size( new_addr_type block_addr, const mem_fetch *mf ) const
+{
+    unsigned line_sz = m_config.get_line_sz();
+    if ( g_cache_data == NULL || line_sz > BDI_MAX_LINE || line_sz % 8 != 0 ) 
+        return line_sz;
+    if ( mf == NULL || ( mf->get_access_type() != GLOBAL_ACC_R && mf->get_access_type() != GLOBAL_ACC_W ) ) 
+        return line_sz;
+    unsigned char line[BDI_MAX_LINE];
+    g_cache_data->read( block_addr, line_sz, line );
+    return bdi_size( line, line_sz );
+}
+
+/// Compressed bytes of the lines in a set, or of those waiting for a fill
+unsigned tag_array::set_bytes( unsigned set_index, bool reserved_only ) const
+{
+    unsigned first = set_index*m_config.m_assoc;
+    unsigned last = first + m_config.m_assoc;
+    unsigned bytes = 0;
+    for (unsigned index=first; index<last; index++) {
+        if ( m_status[index] != INVALID && (!reserved_only || reserved(index)) ) 
+            bytes += m_comp_size[index];
+    }
+    return bytes;
+}
+
+/// The line just allocated in idx may not fit with the rest of its set: evict
+/// the others, least recently used first, until it does. probe() left enough
+/// bytes outside of reserved lines for this to succeed.
+void tag_array::make_room( unsigned idx )
+{
+    unsigned set_index = idx / m_config.m_assoc;
+    unsigned first = set_index*m_config.m_assoc;
+    unsigned last = first + m_config.m_assoc;
+    unsigned bytes = set_bytes( set_index, false );
+    while ( bytes > m_config.get_set_bytes() ) {
+        unsigned line = (unsigned)-1;
+        for (unsigned index=first; index<last; index++) {
+            if ( index != idx && m_status[index] != INVALID && !reserved(index) 
+                 && (line == (unsigned)-1 || m_last_access_time[index] < m_last_access_time[line]) ) 
+                line = index;
+        }
+        assert( line != (unsigned)-1 );
+        if( gpu_root )
+            gpu_root->m_hist->evict( m_core_id, m_tag[line], m_type_id );
+        if ( m_status[line] == MODIFIED ) {
+            cache_block_t evicted;
+            evicted.m_block_addr = m_tag[line];
+            evicted.m_status = m_status[line];
+            evicted.m_sector_dirty = m_sector_dirty[line];
+            m_comp_wb.push_back( evicted );
+        }
+        evict_line( line );
+        m_status[line] = INVALID;
+        bytes -= m_comp_size[line];
+    }
+}
+
+bool tag_array::next_writeback( cache_block_t &evicted )
+{
+    if ( m_comp_wb.empty() ) 
+        return false;
+    evicted = m_comp_wb.front();
+    m_comp_wb.pop_front();
+    return true;
+}
+
+bool tag_array::decompress( unsigned idx )
+{
+    if ( m_comp_size == NULL || m_comp_size[idx] >= m_config.get_line_sz() ) 
+        return false;
+    m_decompressions++;
+    return true;
+}
+
 void tag_array::fill( new_addr_type addr, unsigned time )
 {
     assert( m_config.m_alloc_policy == ON_FILL );
     unsigned idx;
     enum cache_request_status status = probe(addr,idx);
     assert(status==MISS); // MSHR should have prevented redundant memory request
-    if( gpu_root )
-        gpu_root->m_hist->del( m_core_id, m_lines[idx].m_block_addr );
-    m_lines[idx].allocate( m_config.tag(addr), m_config.block_addr(addr), time );
-    m_lines[idx].fill(time);
+    if( gpu_root && !m_victim && m_status[idx] != INVALID )
+        gpu_root->m_hist->evict( m_core_id, m_tag[idx], m_type_id );
+    allocate_line( idx, m_config.tag(addr), time, NULL );
+    fill_line( idx, m_config.full_sector_mask() );
 }
 
-void tag_array::fill( unsigned index, unsigned time ) 
+void tag_array::fill( unsigned index, unsigned time, unsigned sectors ) 
 {
     assert( m_config.m_alloc_policy == ON_MISS );
-    m_lines[index].fill(time);
+    fill_line( index, sectors );
     if( gpu_root ){
-        hist_ctr_FILL_TIME += (time - m_lines[index].m_alloc_time);
+        hist_ctr_FILL_TIME += (time - m_alloc_time[index]);
         hist_ctr_FILL++;
     }
 }
 
 void tag_array::flush() 
 {
+    // Pisacha: under the FLUSH boundary policy HIST drops all the bits of this
+    //          SM at once instead of one eviction per line
+    bool per_line = gpu_root && !gpu_root->m_hist->flush_batched();
     for (unsigned i=0; i < m_config.get_num_lines(); i++){
-        m_lines[i].m_status = INVALID;
-        if( gpu_root )
-            gpu_root->m_hist->del( m_core_id, m_lines[i].m_block_addr );
+        if( per_line && m_status[i] != INVALID )
+            gpu_root->m_hist->evict( m_core_id, m_tag[i], m_type_id );
+        m_status[i] = INVALID;
+        m_sector_pending[i] = 0;
+    }
+    if ( m_victim ) {
+        for (unsigned i=0; i < m_victim->size(); i++) {
+            if( per_line && m_victim->valid(i) )
+                gpu_root->m_hist->evict( m_core_id, m_victim->get_block_addr(i), m_type_id );
+        }
+        m_victim->flush();
+    }
+    if( gpu_root && !per_line )
+        gpu_root->m_hist->flush_sm( m_core_id );
+}
+
+bool tag_array::invalidate( new_addr_type addr )
+{
+    bool victim_inv = m_victim && m_victim->remove( m_config.tag(addr) ) != 0;
+    unsigned idx = lookup(addr);
+    if( idx == (unsigned)-1 || m_status[idx] != VALID || m_sector_pending[idx] != 0 )
+        return victim_inv;
+    m_status[idx] = INVALID;
+    return true;
+}
+
+/// Victim cache hit: the line comes back into idx, whose line takes its place
+void tag_array::victim_swap( new_addr_type addr, unsigned idx, unsigned time, unsigned sectors, bool &wb, cache_block_t &evicted )
+{
+    m_access++;
+    m_miss++;
+    unsigned valid, used;
+    m_victim->take( m_config.tag(addr), valid, used );
+    if( m_status[idx] == MODIFIED ) {
+        wb = true;
+        evicted.m_block_addr = m_tag[idx];
+        evicted.m_status = m_status[idx];
+        evicted.m_sector_dirty = m_sector_dirty[idx];
     }
+    allocate_line( idx, m_config.tag(addr), time, NULL );
+    m_status[idx] = VALID;
+    m_sector_valid[idx] = valid;
+    m_sector_used[idx] = used;
+    mark_used( idx, sectors );
+}
+
+/// A line in the victim cache is still registered with its HIST home, which
+/// only hears of it when it drops out of there
+bool tag_array::holds( new_addr_type addr ) const
+{
+    unsigned idx;
+    if ( probe( addr, idx ) == HIT ) 
+        return true;
+    return m_victim && m_victim->probe( m_config.tag(addr), m_config.full_sector_mask() );
+}
+
+/// A write leaves no stale copy in the victim cache
+void tag_array::victim_invalidate( new_addr_type addr )
+{
+    if ( m_victim && m_victim->remove( m_config.tag(addr) ) && gpu_root ) 
+        gpu_root->m_hist->evict( m_core_id, m_config.tag(addr), m_type_id );
+}
+
+new_addr_type tag_array::fetch_addr( new_addr_type addr, unsigned idx, unsigned &sectors ) const
+{
+    new_addr_type block_addr = m_config.block_addr(addr);
+    if ( !m_config.sectored() ) {
+        sectors = m_config.full_sector_mask();
+        return block_addr;
+    }
+    if ( idx != (unsigned)-1 && resident(idx, addr) ) {
+        sectors &= ~m_sector_valid[idx];
+        if ( sectors & m_sector_pending[idx] ) {
+            // already on its way: merge with that fetch
+            unsigned fetch = m_sector_fetch[idx*MAX_CACHE_SECTORS + first_sector(sectors)];
+            sectors = 0;
+            return block_addr + fetch*m_config.get_sector_sz();
+        }
+    }
+    // one fetch is one run of sectors: valid ones between two missing
+    // sectors are read again
+    sectors = sector_span( sectors );
+    return block_addr + first_sector(sectors)*m_config.get_sector_sz();
 }
 
 float tag_array::windowed_miss_rate( ) const
@@ -360,64 +1189,158 @@ bool was_read_sent( const std::list<cache_event> &events )
 }
 /****************************************************************** MSHR ******************************************************************/
 
+mshr_table::mshr_table( unsigned num_entries, unsigned max_merged )
+    : m_num_entries(num_entries),
+      m_max_merged(max_merged),
+      m_entries(num_entries),
+      m_merged(num_entries*max_merged, (mem_fetch*)NULL),
+      m_ready(num_entries),
+      m_ready_head(0),
+      m_ready_count(0)
+{
+    assert( num_entries > 0 && max_merged > 0 );
+    m_slot_bits = 1;
+    while ( (1U << m_slot_bits) < 2*num_entries ) 
+        m_slot_bits++;
+    mshr_slot empty = { 0, (unsigned)-1 };
+    m_slots.assign( 1U << m_slot_bits, empty );
+    m_free.reserve( num_entries );
+    for ( unsigned e=num_entries; e > 0; e-- ) 
+        m_free.push_back( e-1 );
+}
+
+unsigned mshr_table::hash( new_addr_type block_addr ) const{
+    unsigned long long h = (unsigned long long)block_addr * 0x9E3779B97F4A7C15ULL;
+    return (unsigned)(h >> (64 - m_slot_bits));
+}
+
+/// Slot holding block_addr, or (unsigned)-1
+unsigned mshr_table::find_slot( new_addr_type block_addr ) const{
+    unsigned mask = m_slots.size() - 1;
+    for ( unsigned s = hash(block_addr); ; s = (s+1) & mask ) {
+        if ( m_slots[s].m_entry == (unsigned)-1 ) 
+            return (unsigned)-1;
+        if ( m_slots[s].m_block_addr == block_addr ) 
+            return s;
+    }
+}
+
+/// Free an entry and remove its slot. Later slots of the same probe run are
+/// shifted back into the hole, so the index never needs tombstones.
+void mshr_table::release( unsigned entry ){
+    unsigned mask = m_slots.size() - 1;
+    unsigned hole = find_slot( m_entries[entry].m_block_addr );
+    assert( hole != (unsigned)-1 );
+    for ( unsigned s = (hole+1) & mask; m_slots[s].m_entry != (unsigned)-1; s = (s+1) & mask ) {
+        unsigned home = hash( m_slots[s].m_block_addr );
+        if ( ((s - home) & mask) >= ((s - hole) & mask) ) {
+            m_slots[hole] = m_slots[s];
+            hole = s;
+        }
+    }
+    m_slots[hole].m_entry = (unsigned)-1;
+    m_free.push_back( entry );
+}
+
 /// Checks if there is a pending request to the lower memory level already
 bool mshr_table::probe( new_addr_type block_addr ) const{
-    table::const_iterator a = m_data.find(block_addr);
-    return a != m_data.end();
+    return find_slot(block_addr) != (unsigned)-1;
 }
 
 /// Checks if there is space for tracking a new memory access
 bool mshr_table::full( new_addr_type block_addr ) const{
-    table::const_iterator i=m_data.find(block_addr);
-    if ( i != m_data.end() )
-        return i->second.m_list.size() >= m_max_merged;
+    unsigned s = find_slot(block_addr);
+    if ( s != (unsigned)-1 )
+        return m_entries[m_slots[s].m_entry].m_count >= m_max_merged;
     else
-        return m_data.size() >= m_num_entries;
+        return m_free.empty();
 }
 
 /// Add or merge this access
 void mshr_table::add( new_addr_type block_addr, mem_fetch *mf ){
-	m_data[block_addr].m_list.push_back(mf);
-	assert( m_data.size() <= m_num_entries );
-	assert( m_data[block_addr].m_list.size() <= m_max_merged );
+    unsigned mask = m_slots.size() - 1;
+    unsigned s = hash(block_addr);
+    while ( m_slots[s].m_entry != (unsigned)-1 && m_slots[s].m_block_addr != block_addr ) 
+        s = (s+1) & mask;
+    if ( m_slots[s].m_entry == (unsigned)-1 ) {
+        assert( !m_free.empty() );
+        unsigned e = m_free.back();
+        m_free.pop_back();
+        m_slots[s].m_block_addr = block_addr;
+        m_slots[s].m_entry = e;
+        m_entries[e].m_block_addr = block_addr;
+        m_entries[e].m_head = 0;
+        m_entries[e].m_count = 0;
+        m_entries[e].m_has_atomic = false;
+    }
+    unsigned e = m_slots[s].m_entry;
+    mshr_entry &entry = m_entries[e];
+    assert( entry.m_count < m_max_merged );
+    m_merged[ e*m_max_merged + (entry.m_head + entry.m_count) % m_max_merged ] = mf;
+    entry.m_count++;
 	// indicate that this MSHR entry contains an atomic operation
 	if ( mf->isatomic() ) {
-		m_data[block_addr].m_has_atomic = true;
+		entry.m_has_atomic = true;
 	}
 }
 
 /// Accept a new cache fill response: mark entry ready for processing
 void mshr_table::mark_ready( new_addr_type block_addr, bool &has_atomic ){
     assert( !busy() );
-    table::iterator a = m_data.find(block_addr);
-    assert( a != m_data.end() ); // don't remove same request twice
-    m_current_response.push_back( block_addr );
-    has_atomic = a->second.m_has_atomic;
-    assert( m_current_response.size() <= m_data.size() );
+    unsigned s = find_slot(block_addr);
+    assert( s != (unsigned)-1 ); // don't remove same request twice
+    assert( m_ready_count < m_num_entries - m_free.size() );
+    m_ready[ (m_ready_head + m_ready_count) % m_num_entries ] = m_slots[s].m_entry;
+    m_ready_count++;
+    has_atomic = m_entries[m_slots[s].m_entry].m_has_atomic;
+}
+
+void mshr_table::mark_ready_prefetch( new_addr_type block_addr, mem_fetch *mf, bool &has_atomic ){
+    unsigned s = find_slot(block_addr);
+    assert( s != (unsigned)-1 );
+    unsigned e = m_slots[s].m_entry;
+    mshr_entry &entry = m_entries[e];
+    assert( m_merged[ e*m_max_merged + entry.m_head ] == mf );
+    entry.m_head = (entry.m_head + 1) % m_max_merged;
+    entry.m_count--;
+    if ( entry.m_count == 0 ) {
+        // nobody asked for it yet
+        has_atomic = false;
+        release( e );
+    } else {
+        mark_ready( block_addr, has_atomic );
+    }
 }
 
 /// Returns next ready access
 mem_fetch *mshr_table::next_access(){
     assert( access_ready() );
-    new_addr_type block_addr = m_current_response.front();
-    assert( !m_data[block_addr].m_list.empty() );
-    mem_fetch *result = m_data[block_addr].m_list.front();
-    m_data[block_addr].m_list.pop_front();
-    if ( m_data[block_addr].m_list.empty() ) {
+    unsigned e = m_ready[m_ready_head];
+    mshr_entry &entry = m_entries[e];
+    assert( entry.m_count > 0 );
+    mem_fetch *result = m_merged[ e*m_max_merged + entry.m_head ];
+    entry.m_head = (entry.m_head + 1) % m_max_merged;
+    entry.m_count--;
+    if ( entry.m_count == 0 ) {
         // release entry
-        m_data.erase(block_addr);
-        m_current_response.pop_front();
+        release( e );
+        m_ready_head = (m_ready_head + 1) % m_num_entries;
+        m_ready_count--;
     }
     return result;
 }
 
 void mshr_table::display( FILE *fp ) const{
     fprintf(fp,"MSHR contents\n");
-    for ( table::const_iterator e=m_data.begin(); e!=m_data.end(); ++e ) {
-        unsigned block_addr = e->first;
-        fprintf(fp,"MSHR: tag=0x%06x, atomic=%d %zu entries : ", block_addr, e->second.m_has_atomic, e->second.m_list.size());
-        if ( !e->second.m_list.empty() ) {
-            mem_fetch *mf = e->second.m_list.front();
+    for ( unsigned s=0; s < m_slots.size(); s++ ) {
+        if ( m_slots[s].m_entry == (unsigned)-1 ) 
+            continue;
+        unsigned e = m_slots[s].m_entry;
+        const mshr_entry &entry = m_entries[e];
+        unsigned block_addr = entry.m_block_addr;
+        fprintf(fp,"MSHR: tag=0x%06x, atomic=%d %u entries : ", block_addr, entry.m_has_atomic, entry.m_count);
+        if ( entry.m_count > 0 ) {
+            mem_fetch *mf = m_merged[ e*m_max_merged + entry.m_head ];
             fprintf(fp,"%p :",mf);
             mf->print(fp);
         } else {
@@ -425,6 +1348,46 @@ void mshr_table::display( FILE *fp ) const{
         }
     }
 }
+/// Pending requests are written as request ids only: a mem_fetch cannot be
+/// rebuilt from a file, so checkpoints are meant to be taken with empty MSHRs
+void mshr_table::save_state( FILE *fp ) const
+{
+    unsigned n = m_num_entries - m_free.size();
+    ckpt_write( fp, n );
+    for ( unsigned s=0; s < m_slots.size(); s++ ) {
+        if ( m_slots[s].m_entry == (unsigned)-1 ) 
+            continue;
+        unsigned e = m_slots[s].m_entry;
+        const mshr_entry &entry = m_entries[e];
+        new_addr_type block_addr = entry.m_block_addr;
+        unsigned has_atomic = entry.m_has_atomic;
+        unsigned n_merged = entry.m_count;
+        ckpt_write( fp, block_addr );
+        ckpt_write( fp, has_atomic );
+        ckpt_write( fp, n_merged );
+        for ( unsigned m=0; m < n_merged; m++ ) {
+            unsigned uid = m_merged[ e*m_max_merged + (entry.m_head + m) % m_max_merged ]->get_request_uid();
+            ckpt_write( fp, uid );
+        }
+    }
+}
+
+void mshr_table::load_state( FILE *fp )
+{
+    unsigned n;
+    ckpt_read( fp, n );
+    for ( unsigned i=0; i<n; i++ ) {
+        new_addr_type block_addr;
+        unsigned has_atomic, n_merged, uid;
+        ckpt_read( fp, block_addr );
+        ckpt_read( fp, has_atomic );
+        ckpt_read( fp, n_merged );
+        for ( unsigned j=0; j<n_merged; j++ ) 
+            ckpt_read( fp, uid );
+    }
+    if ( n > 0 ) 
+        printf("GPGPU-Sim: %u pending MSHR entries in checkpoint dropped\n", n);
+}
 /***************************************************************** Caches *****************************************************************/
 cache_stats::cache_stats(){
     m_stats.resize(NUM_MEM_ACCESS_TYPE);
@@ -556,6 +1519,59 @@ void cache_sub_stats::print_port_stats(FILE *fout, const char *cache_name) const
     fprintf(fout, "%s_fill_port_util = %.3f\n", cache_name, fill_port_util); 
 }
 
+void cache_sub_stats::print_sector_stats(FILE *fout, const char *cache_name) const
+{
+    fprintf(fout, "%s_fetched_bytes = %llu\n", cache_name, fetched_bytes); 
+    fprintf(fout, "%s_used_bytes = %llu\n", cache_name, used_bytes); 
+    float used_ratio = 0.0f; 
+    if (fetched_bytes > 0) {
+        used_ratio = (float) used_bytes / fetched_bytes; 
+    }
+    fprintf(fout, "%s_used_fetched_ratio = %.3f\n", cache_name, used_ratio); 
+}
+
+void tag_array::get_set_stats(float &max_ratio, float &sum_ratio, unsigned &n_caches) const
+{
+    unsigned long long total = 0;
+    unsigned long long max_accesses = 0;
+    for (unsigned s = 0; s < m_config.m_nset; s++) {
+        total += m_set_accesses[s];
+        if (m_set_accesses[s] > max_accesses) 
+            max_accesses = m_set_accesses[s];
+    }
+    max_ratio = 0.0f;
+    sum_ratio = 0.0f;
+    n_caches = 0;
+    if (total > 0) {
+        max_ratio = (float) max_accesses * m_config.m_nset / total;
+        sum_ratio = max_ratio;
+        n_caches = 1;
+    }
+}
+
+void cache_sub_stats::print_set_stats(FILE *fout, const char *cache_name) const
+{
+    // busiest set over the average one, per cache; 1.0 is perfectly even
+    float avg_imbalance = 0.0f; 
+    if (set_imbalance_caches > 0) {
+        avg_imbalance = set_imbalance_sum / set_imbalance_caches; 
+    }
+    fprintf(fout, "%s_set_access_imbalance = %.3f\n", cache_name, set_imbalance_max); 
+    fprintf(fout, "%s_set_access_imbalance_avg = %.3f\n", cache_name, avg_imbalance); 
+}
+
+void cache_sub_stats::print_compression_stats(FILE *fout, const char *cache_name) const
+{
+    fprintf(fout, "%s_compressed_raw_bytes = %llu\n", cache_name, comp_raw_bytes); 
+    fprintf(fout, "%s_compressed_bytes = %llu\n", cache_name, comp_bytes); 
+    float ratio = 0.0f; 
+    if (comp_bytes > 0) {
+        ratio = (float) comp_raw_bytes / comp_bytes; 
+    }
+    fprintf(fout, "%s_compression_ratio = %.3f\n", cache_name, ratio); 
+    fprintf(fout, "%s_decompressions = %llu\n", cache_name, decompressions); 
+}
+
 unsigned cache_stats::get_stats(enum mem_access_type *access_type, unsigned num_access_type, enum cache_request_status *access_status, unsigned num_access_status) const{
     ///
     /// Returns a sum of the stats corresponding to each "access_type" and "access_status" pair.
@@ -657,6 +1673,12 @@ void baseline_cache::bandwidth_management::use_data_port(mem_fetch *mf, enum cac
     } 
 }
 
+/// hold the data port while a compressed line is decompressed 
+void baseline_cache::bandwidth_management::use_decompressor()
+{
+    m_data_port_occupied_cycles += m_config.m_decompress_lat; 
+}
+
 /// use the fill port 
 void baseline_cache::bandwidth_management::use_fill_port(mem_fetch *mf)
 {
@@ -742,27 +1764,31 @@ void baseline_cache::cycle(){
 
 /// Interface for response from lower memory level (model bandwidth restictions in caller)
 void baseline_cache::fill(mem_fetch *mf, unsigned time){
-    extra_mf_fields_lookup::iterator e = m_extra_mf_fields.find(mf);
-    assert( e != m_extra_mf_fields.end() );
-    assert( e->second.m_valid );
-    mf->set_data_size( e->second.m_data_size );
+    extra_mf_fields *f = m_extra_mf_fields.find(mf);
+    assert( f != NULL );
+    assert( f->m_valid );
+    const extra_mf_fields e = *f;
+    m_extra_mf_fields.erase(mf);
+    mf->set_addr( e.m_addr );
+    mf->set_data_size( e.m_data_size );
     if ( m_config.m_alloc_policy == ON_MISS )
-        m_tag_array->fill(e->second.m_cache_index,time);
+        m_tag_array->fill(e.m_cache_index,time,e.m_sectors);
     else if ( m_config.m_alloc_policy == ON_FILL )
-        m_tag_array->fill(e->second.m_block_addr,time);
+        m_tag_array->fill(e.m_block_addr,time);
     else abort();
     bool has_atomic = false;
-    m_mshrs.mark_ready(e->second.m_block_addr, has_atomic);
+    if ( e.m_prefetch ) 
+        m_mshrs.mark_ready_prefetch(e.m_mshr_addr, mf, has_atomic);
+    else
+        m_mshrs.mark_ready(e.m_mshr_addr, has_atomic);
     if (has_atomic) {
         assert(m_config.m_alloc_policy == ON_MISS);
-        cache_block_t &block = m_tag_array->get_block(e->second.m_cache_index);
-        block.m_status = MODIFIED; // mark line as dirty for atomic operation
+        m_tag_array->mark_dirty(e.m_cache_index, e.m_sectors); // mark line as dirty for atomic operation
     }
-    m_extra_mf_fields.erase(mf);
     m_bandwidth_management.use_fill_port(mf); 
 
 /// HIST
-    if( gpu_root != NULL && e->second.m_block_addr != 0 )
+    if( gpu_root != NULL && e.m_block_addr != 0 )
     {
         hist_request_status probe_res;
         probe_res     = gpu_root->m_hist->probe( mf->get_addr() );
@@ -774,12 +1800,15 @@ void baseline_cache::fill(mem_fetch *mf, unsigned time){
         }
     }
 /// HIST
+    // a prefetch ends here, the caller must not touch mf again
+    if ( e.m_prefetch ) {
+        delete mf;
+    }
 }
 
 /// Checks if mf is waiting to be filled by lower memory level
 bool baseline_cache::waiting_for_fill( mem_fetch *mf ){
-    extra_mf_fields_lookup::iterator e = m_extra_mf_fields.find(mf);
-    return e != m_extra_mf_fields.end();
+    return m_extra_mf_fields.contains(mf);
 }
 
 void baseline_cache::print(FILE *fp, unsigned &accesses, unsigned &misses) const{
@@ -806,42 +1835,37 @@ void baseline_cache::send_read_request(new_addr_type addr, new_addr_type block_a
 void baseline_cache::send_read_request(new_addr_type addr, new_addr_type block_addr, unsigned cache_index, mem_fetch *mf,
 		unsigned time, bool &do_miss, bool &wb, cache_block_t &evicted, std::list<cache_event> &events, bool read_only, bool wa){
 
-    bool mshr_hit = m_mshrs.probe(block_addr);
-    bool mshr_avail = !m_mshrs.full(block_addr);
+    // a sectored cache keys its MSHRs by the first sector of each fetch
+    unsigned sectors = m_config.sector_mask(mf);
+    new_addr_type mshr_addr = m_tag_array->fetch_addr(addr, cache_index, sectors);
+    bool mshr_hit = m_mshrs.probe(mshr_addr);
+    bool mshr_avail = !m_mshrs.full(mshr_addr);
     if ( mshr_hit && mshr_avail ) {
     	if(read_only)
-    		m_tag_array->access(block_addr,time,cache_index);
+    		m_tag_array->access(block_addr,time,cache_index,mf);
     	else
-    		m_tag_array->access(block_addr,time,cache_index,wb,evicted);
+    		m_tag_array->access(block_addr,time,cache_index,wb,evicted,mf);
 
-        m_mshrs.add(block_addr,mf);
+        m_mshrs.add(mshr_addr,mf);
+        mf_stage( mf, m_miss_queue_status, time );
         do_miss = true;
     } else if ( !mshr_hit && mshr_avail && (m_miss_queue.size() < m_config.m_miss_queue_size) ) {
     	if(read_only)
-    		m_tag_array->access(block_addr,time,cache_index);
+    		m_tag_array->access(block_addr,time,cache_index,mf);
     	else
-    		m_tag_array->access(block_addr,time,cache_index,wb,evicted);
-
-        m_mshrs.add(block_addr,mf);
-        m_extra_mf_fields[mf] = extra_mf_fields(block_addr,cache_index, mf->get_data_size());
-        mf->set_data_size( m_config.get_line_sz() );
-    /// HIST
-        if( gpu_root != NULL && block_addr != 0 )
-        {
-            enum hist_request_status probe_res;
-            probe_res      = gpu_root->m_hist->probe( mf->get_addr() );
-            unsigned home  = gpu_root->m_hist->get_home( mf->get_addr() );
-            unsigned NOC_d = gpu_root->m_hist->NOC_distance( m_core_id, home );
-            
-            out_mf.push_back( mf );
-            mf->set_wait( NOC_d + 1, time, &m_miss_queue );
-            hist_ctr_TOT++;
-            goto skip_push;
+    		m_tag_array->access(block_addr,time,cache_index,wb,evicted,mf);
+
+        m_mshrs.add(mshr_addr,mf);
+        m_extra_mf_fields.insert(mf, extra_mf_fields(block_addr,cache_index, mf->get_addr(), mf->get_data_size(), mshr_addr, sectors));
+        // the request goes down as the fetch: from the first missing sector,
+        // for as many sectors as are read
+        mf->set_addr( mshr_addr );
+        mf->set_data_size( m_config.sector_bytes(sectors) );
+        if( !hist_send( mf, block_addr, time ) ){
+            m_miss_queue.push_back(mf);
+            mf->set_status(m_miss_queue_status,time);
+            mf_stage( mf, m_miss_queue_status, time );
         }
-    /// HIST
-        m_miss_queue.push_back(mf);
-skip_push:
-        mf->set_status(m_miss_queue_status,time);
         if(!wa)
         	events.push_back(READ_REQUEST_SENT);
         do_miss = true;
@@ -849,11 +1873,112 @@ skip_push:
 }
 
 
+/// HIST
+/// A read miss that the page filter does not bypass probes its home first,
+/// and only falls back to m_miss_queue if the home cannot forward the line
+bool baseline_cache::hist_send( mem_fetch *mf, new_addr_type block_addr, unsigned time )
+{
+    if( gpu_root == NULL || block_addr == 0 || gpu_root->m_hist->bypass( m_core_id, mf ) )
+        return false;
+
+    // the lookup at the sender is what set_distribute counts per set
+    gpu_root->m_hist->probe( mf->get_addr() );
+    unsigned home  = gpu_root->m_hist->get_home( mf->get_addr() );
+    unsigned NOC_d = gpu_root->m_hist->NOC_distance( m_core_id, home );
+
+    out_mf.push_back( mf );
+    mf->set_wait( NOC_d + 1, time, &m_miss_queue );
+    mf->set_status(m_miss_queue_status,time);
+    mf_stage( mf, MF_STAGE_HIST_NOC, time );
+    hist_ctr_TOT++;
+    return true;
+}
+/// HIST
+
 /// Sends write request to lower level memory (write or writeback)
 void data_cache::send_write_request(mem_fetch *mf, cache_event request, unsigned time, std::list<cache_event> &events){
     events.push_back(request);
     m_miss_queue.push_back(mf);
     mf->set_status(m_miss_queue_status,time);
+    mf_stage( mf, m_miss_queue_status, time );
+}
+
+/// A prefetch is only sent if the line is absent and an MSHR and two miss
+/// queue slots (read and writeback) are free, so it never holds up a demand
+/// miss. It is not a cache access: m_stats never sees it, and its fill is
+/// consumed in fill() instead of being handed back to the core.
+void data_cache::issue_prefetch( new_addr_type block_addr, const mem_fetch *trigger, unsigned time )
+{
+    unsigned cache_index = (unsigned)-1;
+    unsigned sectors = m_config.full_sector_mask();
+    if ( m_tag_array->probe( block_addr, cache_index, sectors ) != MISS ) 
+        return; // present, on its way, or no line to replace
+    new_addr_type mshr_addr = m_tag_array->fetch_addr( block_addr, cache_index, sectors );
+    assert( !m_mshrs.probe(mshr_addr) );
+    if ( m_mshrs.full(mshr_addr) || miss_queue_full(1) ) {
+        l1d_pf_ctr_DROP++;
+        return;
+    }
+    bool wb = false;
+    cache_block_t evicted;
+    new_addr_type displaced;
+    if ( m_tag_array->prefetch( block_addr, cache_index, time, sectors, wb, evicted, displaced, trigger ) ) 
+        m_prefetcher->displaced( displaced );
+    mem_fetch *mf = m_memfetch_creator->alloc( mshr_addr, trigger->get_access_type(),
+                                               m_config.sector_bytes(sectors), false );
+    m_mshrs.add( mshr_addr, mf );
+    m_extra_mf_fields.insert( mf, extra_mf_fields(block_addr, cache_index, mf->get_addr(), mf->get_data_size(), mshr_addr, sectors, true) );
+    // like a demand miss it goes through the HIST home, which records this
+    // SM as a sharer of the line
+    if( !hist_send( mf, block_addr, time ) ){
+        m_miss_queue.push_back( mf );
+        mf->set_status( m_miss_queue_status, time );
+        mf_stage( mf, m_miss_queue_status, time );
+    }
+    l1d_pf_ctr_ISSUED++;
+    // writebacks are real traffic, but not events of the demand access
+    std::list<cache_event> events;
+    if( wb && (m_config.m_write_policy != WRITE_THROUGH) ){ 
+        send_writeback(evicted, time, events);
+    }
+    if( m_config.compressed() )
+        send_compression_writebacks( time, events );
+}
+
+/// One writeback per contiguous run of dirty sectors, sent at the address of
+/// its first sector, so that a sectored next level marks the right sectors
+/// dirty. An unsectored line is written back whole. A line whose dirty
+/// sectors are not contiguous may briefly run the miss queue over its size.
+void data_cache::send_writeback( const cache_block_t &evicted, unsigned time, std::list<cache_event> &events )
+{
+    unsigned dirty = m_config.sectored()? evicted.m_sector_dirty : m_config.full_sector_mask();
+    if ( dirty == 0 ) 
+        dirty = m_config.full_sector_mask();
+    unsigned s = 0;
+    while ( s < m_config.get_num_sectors() ) {
+        if ( !((dirty >> s) & 1) ) {
+            s++;
+            continue;
+        }
+        unsigned first = s;
+        while ( s < m_config.get_num_sectors() && ((dirty >> s) & 1) ) 
+            s++;
+        mem_fetch *wb = m_memfetch_creator->alloc(evicted.m_block_addr + first*m_config.get_sector_sz(),
+            m_wrbk_type,(s-first)*m_config.get_sector_sz(),true);
+        send_write_request(wb, WRITE_BACK_REQUEST_SENT, time, events);
+    }
+}
+
+/// These come on top of the single writeback a miss has room for in the miss
+/// queue, which may briefly run over its size
+void data_cache::send_compression_writebacks( unsigned time, std::list<cache_event> &events )
+{
+    cache_block_t evicted;
+    while( m_tag_array->next_writeback( evicted ) ) {
+        if( m_config.m_write_policy == WRITE_THROUGH ) 
+            continue;
+        send_writeback(evicted, time, events);
+    }
 }
 
 
@@ -862,9 +1987,8 @@ void data_cache::send_write_request(mem_fetch *mf, cache_event request, unsigned
 /// Write-back hit: Mark block as modified
 cache_request_status data_cache::wr_hit_wb(new_addr_type addr, unsigned cache_index, mem_fetch *mf, unsigned time, std::list<cache_event> &events, enum cache_request_status status ){
 	new_addr_type block_addr = m_config.block_addr(addr);
-	m_tag_array->access(block_addr,time,cache_index); // update LRU state
-	cache_block_t &block = m_tag_array->get_block(cache_index);
-	block.m_status = MODIFIED;
+	m_tag_array->access(block_addr,time,cache_index,mf); // update LRU state
+	m_tag_array->mark_dirty(cache_index, m_config.sector_mask(mf));
 
 	return HIT;
 }
@@ -875,9 +1999,8 @@ cache_request_status data_cache::wr_hit_wt(new_addr_type addr, unsigned cache_in
 		return RESERVATION_FAIL; // cannot handle request this cycle
 
 	new_addr_type block_addr = m_config.block_addr(addr);
-	m_tag_array->access(block_addr,time,cache_index); // update LRU state
-	cache_block_t &block = m_tag_array->get_block(cache_index);
-	block.m_status = MODIFIED;
+	m_tag_array->access(block_addr,time,cache_index,mf); // update LRU state
+	m_tag_array->mark_dirty(cache_index, m_config.sector_mask(mf));
 
 	// generate a write-through
 	send_write_request(mf, WRITE_REQUEST_SENT, time, events);
@@ -891,12 +2014,13 @@ cache_request_status data_cache::wr_hit_we(new_addr_type addr, unsigned cache_in
 		return RESERVATION_FAIL; // cannot handle request this cycle
 
 	// generate a write-through/evict
-	cache_block_t &block = m_tag_array->get_block(cache_index);
 	send_write_request(mf, WRITE_REQUEST_SENT, time, events);
 
-	// Invalidate block
-	block.m_status = INVALID;
-    gpu_root->m_hist->del( m_core_id, mf->get_addr() );
+	// Invalidate block (the written sectors of a sectored one)
+	m_tag_array->invalidate_sectors(cache_index, m_config.sector_mask(mf));
+    // the home only hears of it once nothing of the line is left here
+    if( gpu_root && m_tag_array->get_status(cache_index) == INVALID )
+        gpu_root->m_hist->evict( m_core_id, mf->get_addr(), m_tag_array->get_type_id() );
 
 	return HIT;
 }
@@ -924,8 +2048,10 @@ data_cache::wr_miss_wa( new_addr_type addr,
 
     // Write allocate, maximum 3 requests (write miss, read request, write back request)
     // Conservatively ensure the worst-case request can be handled this cycle
-    bool mshr_hit = m_mshrs.probe(block_addr);
-    bool mshr_avail = !m_mshrs.full(block_addr);
+    unsigned sectors = m_config.sector_mask(mf);
+    new_addr_type mshr_addr = m_tag_array->fetch_addr(addr, cache_index, sectors);
+    bool mshr_hit = m_mshrs.probe(mshr_addr);
+    bool mshr_avail = !m_mshrs.full(mshr_addr);
     if(miss_queue_full(2) 
         || (!(mshr_hit && mshr_avail) 
         && !(!mshr_hit && mshr_avail 
@@ -964,10 +2090,9 @@ data_cache::wr_miss_wa( new_addr_type addr,
         // If evicted block is modified and not a write-through
         // (already modified lower level)
         if( wb && (m_config.m_write_policy != WRITE_THROUGH) ) { 
-            mem_fetch *wb = m_memfetch_creator->alloc(evicted.m_block_addr,
-                m_wrbk_type,m_config.get_line_sz(),true);
-            m_miss_queue.push_back(wb);
-            wb->set_status(m_miss_queue_status,time);
+            // not an event of this write: the list is dropped
+            std::list<cache_event> wb_events;
+            send_writeback(evicted, time, wb_events);
         }
         return MISS;
     }
@@ -1006,13 +2131,12 @@ data_cache::rd_hit_base( new_addr_type addr,
                          enum cache_request_status status )
 {
     new_addr_type block_addr = m_config.block_addr(addr);
-    m_tag_array->access(block_addr,time,cache_index);
+    m_tag_array->access(block_addr,time,cache_index,mf);
     // Atomics treated as global read/write requests - Perform read, mark line as
     // MODIFIED
     if(mf->isatomic()){ 
         assert(mf->get_access_type() == GLOBAL_ACC_R);
-        cache_block_t &block = m_tag_array->get_block(cache_index);
-        block.m_status = MODIFIED;  // mark line as dirty
+        m_tag_array->mark_dirty(cache_index, m_config.sector_mask(mf));  // mark line as dirty
     }
     return HIT;
 }
@@ -1046,9 +2170,7 @@ data_cache::rd_miss_base( new_addr_type addr,
         // If evicted block is modified and not a write-through
         // (already modified lower level)
         if(wb && (m_config.m_write_policy != WRITE_THROUGH) ){ 
-            mem_fetch *wb = m_memfetch_creator->alloc(evicted.m_block_addr,
-                m_wrbk_type,m_config.get_line_sz(),true);
-        send_write_request(wb, WRITE_BACK_REQUEST_SENT, time, events);
+            send_writeback(evicted, time, events);
     }
         return MISS;
     }
@@ -1072,7 +2194,7 @@ read_only_cache::access( new_addr_type addr,
     enum cache_request_status cache_status = RESERVATION_FAIL;
 
     if ( status == HIT ) {
-        cache_status = m_tag_array->access(block_addr,time,cache_index); // update LRU state
+        cache_status = m_tag_array->access(block_addr,time,cache_index,mf); // update LRU state
     }else if ( status != RESERVATION_FAIL ) {
         if(!miss_queue_full(0)){
             bool do_miss=false;
@@ -1117,6 +2239,13 @@ data_cache::process_tag_probe( bool wr,
                                        cache_index,
                                        mf, time, events, probe_status );
         }
+    /// HIST
+        if( gpu_root != NULL && access_status != RESERVATION_FAIL ){
+            if( gpu_root->m_hist->page_filter_enabled() )
+                gpu_root->m_hist->page_access( m_core_id, addr, true );
+            gpu_root->m_hist->write( m_core_id, addr, time );
+        }
+    /// HIST
     }else{ // Read
         if(probe_status == HIT){
             access_status = (this->*m_rd_hit)( addr,
@@ -1127,8 +2256,12 @@ data_cache::process_tag_probe( bool wr,
                                        cache_index,
                                        mf, time, events, probe_status );
         }
+        if( access_status == HIT && m_tag_array->decompress(cache_index) )
+            m_bandwidth_management.use_decompressor();
     }
 
+    if( m_config.compressed() )
+        send_compression_writebacks( time, events );
     m_bandwidth_management.use_data_port(mf, access_status, events); 
     return access_status;
 }
@@ -1150,11 +2283,20 @@ data_cache::access( new_addr_type addr,
     new_addr_type block_addr = m_config.block_addr(addr);
     unsigned cache_index = (unsigned)-1;
     enum cache_request_status probe_status
-        = m_tag_array->probe( block_addr, cache_index );
+        = m_tag_array->probe( block_addr, cache_index, m_config.sector_mask(mf) );
     enum cache_request_status access_status
         = process_tag_probe( wr, probe_status, addr, cache_index, mf, time, events );
     m_stats.inc_stats(mf->get_access_type(),
         m_stats.select_stats_status(probe_status, access_status));
+    if ( m_prefetcher && !wr && access_status != RESERVATION_FAIL ) {
+        bool miss = (probe_status == MISS);
+        if ( miss && m_prefetcher->polluted(block_addr) ) 
+            l1d_pf_ctr_POLLUTION++;
+        std::vector<new_addr_type> candidates;
+        m_prefetcher->observe( addr, mf->get_pc(), miss, candidates );
+        for ( unsigned c=0; c < candidates.size(); c++ ) 
+            issue_prefetch( candidates[c], mf, time );
+    }
     return access_status;
 }
 
@@ -1168,7 +2310,262 @@ l1_cache::access( new_addr_type addr,
                   unsigned time,
                   std::list<cache_event> &events )
 {
-    return data_cache::access( addr, mf, time, events );
+    if ( m_victim ) {
+        if ( mf->get_is_write() ) {
+            m_tag_array->victim_invalidate( m_config.block_addr(addr) );
+        } else if ( !mf->isatomic() ) {
+            enum cache_request_status status = victim_access( addr, mf, time, events );
+            if ( status != MISS ) 
+                return status;
+        }
+    }
+    enum cache_request_status status = data_cache::access( addr, mf, time, events );
+    if ( m_bypass_pred && status == MISS && !mf->get_is_write() ) {
+        // tag the line this load allocated with its PC for predictor training
+        unsigned idx;
+        if ( m_tag_array->probe( m_config.block_addr(addr), idx, m_config.sector_mask(mf) ) == HIT_RESERVED ) 
+            m_tag_array->set_signature( idx, m_bypass_pred->signature(mf->get_pc()), m_bypass_pred->predict_dead(mf->get_pc()) );
+    }
+    return status;
+}
+
+/// Victim cache lookup on an L1D read miss. HIT: the line was swapped back
+/// in. RESERVATION_FAIL: it is in the victim cache but cannot be swapped this
+/// cycle. MISS: carry on with the normal miss path.
+enum cache_request_status
+l1_cache::victim_access( new_addr_type addr,
+                         mem_fetch *mf,
+                         unsigned time,
+                         std::list<cache_event> &events )
+{
+    new_addr_type block_addr = m_config.block_addr(addr);
+    unsigned sectors = m_config.sector_mask(mf);
+    unsigned cache_index = (unsigned)-1;
+    if ( m_tag_array->probe( block_addr, cache_index, sectors ) != MISS ) 
+        return MISS;
+    if ( !m_victim->use_port( time ) ) {
+        l1d_vc_ctr_PORT_STALL++;
+        return MISS;
+    }
+    if ( !m_victim->probe( block_addr, sectors ) ) {
+        l1d_vc_ctr_MISS++;
+        return MISS;
+    }
+    // the swap writes the line into the data array and may write back the
+    // line it replaces
+    if ( !m_bandwidth_management.fill_port_free() || miss_queue_full(0) ) {
+        l1d_vc_ctr_SWAP_STALL++;
+        m_stats.inc_stats(mf->get_access_type(), RESERVATION_FAIL);
+        return RESERVATION_FAIL;
+    }
+    l1d_vc_ctr_HIT++;
+    bool wb = false;
+    cache_block_t evicted;
+    m_tag_array->victim_swap( block_addr, cache_index, time, sectors, wb, evicted );
+    if( wb && (m_config.m_write_policy != WRITE_THROUGH) ){ 
+        send_writeback(evicted, time, events);
+    }
+    m_bandwidth_management.use_fill_port(mf);
+    m_bandwidth_management.use_data_port(mf, HIT, events);
+    // a miss as far as L1D is concerned, the victim cache counts the hit
+    m_stats.inc_stats(mf->get_access_type(), MISS);
+    return HIT;
+}
+
+l1d_victim_cache::l1d_victim_cache( unsigned entries, unsigned ports )
+: m_stamp(0), m_ports(ports), m_port_cycle(0), m_ports_used(0)
+{
+    assert( entries > 0 && ports > 0 );
+    entry e;
+    e.m_block_addr = 0;
+    e.m_valid = 0;
+    e.m_used = 0;
+    e.m_stamp = 0;
+    m_entries.assign( entries, e );
+}
+
+bool l1d_victim_cache::use_port( unsigned time )
+{
+    if ( time != m_port_cycle ) {
+        m_port_cycle = time;
+        m_ports_used = 0;
+    }
+    if ( m_ports_used == m_ports ) 
+        return false;
+    m_ports_used++;
+    return true;
+}
+
+unsigned l1d_victim_cache::find( new_addr_type block_addr ) const
+{
+    for (unsigned i=0; i < m_entries.size(); i++) {
+        if ( m_entries[i].m_valid && m_entries[i].m_block_addr == block_addr ) 
+            return i;
+    }
+    return (unsigned)-1;
+}
+
+bool l1d_victim_cache::probe( new_addr_type block_addr, unsigned sectors ) const
+{
+    unsigned i = find( block_addr );
+    return i != (unsigned)-1 && (sectors & ~m_entries[i].m_valid) == 0;
+}
+
+unsigned l1d_victim_cache::remove( new_addr_type block_addr )
+{
+    unsigned i = find( block_addr );
+    if ( i == (unsigned)-1 ) 
+        return 0;
+    unsigned valid = m_entries[i].m_valid;
+    m_entries[i].m_valid = 0;
+    return valid;
+}
+
+void l1d_victim_cache::take( new_addr_type block_addr, unsigned &valid, unsigned &used )
+{
+    unsigned i = find( block_addr );
+    assert( i != (unsigned)-1 );
+    valid = m_entries[i].m_valid;
+    used = m_entries[i].m_used;
+    m_entries[i].m_valid = 0;
+}
+
+bool l1d_victim_cache::insert( new_addr_type block_addr, unsigned valid, unsigned used, new_addr_type &dropped )
+{
+    assert( valid != 0 );
+    unsigned slot = find( block_addr );
+    bool full = false;
+    if ( slot == (unsigned)-1 ) {
+        // an empty entry, else the oldest one
+        slot = 0;
+        for (unsigned i=0; i < m_entries.size(); i++) {
+            if ( !m_entries[i].m_valid ) {
+                slot = i;
+                break;
+            }
+            if ( m_entries[i].m_stamp < m_entries[slot].m_stamp ) 
+                slot = i;
+        }
+        full = m_entries[slot].m_valid != 0;
+        dropped = m_entries[slot].m_block_addr;
+    }
+    m_entries[slot].m_block_addr = block_addr;
+    m_entries[slot].m_valid = valid;
+    m_entries[slot].m_used = used;
+    m_entries[slot].m_stamp = ++m_stamp;
+    return full;
+}
+
+void l1d_victim_cache::flush()
+{
+    for (unsigned i=0; i < m_entries.size(); i++) 
+        m_entries[i].m_valid = 0;
+}
+
+bool l1d_bypass_predictor::bypass( address_type pc )
+{
+    if ( !predict_dead(pc) ) 
+        return false;
+    if ( m_sample && ++m_sample_count % m_sample == 0 ) {
+        l1d_bp_ctr_SAMPLE++;
+        return false;
+    }
+    l1d_bp_ctr_BYPASS++;
+    return true;
+}
+
+void l1d_bypass_predictor::train( unsigned sig, bool reused, bool predicted_dead )
+{
+    unsigned char &ctr = m_ctr[sig];
+    if ( reused ) {
+        if ( ctr > 0 ) 
+            ctr--;
+    } else if ( ctr < CTR_MAX ) {
+        ctr++;
+    }
+    if ( predicted_dead ) {
+        if ( reused ) l1d_bp_ctr_DEAD_WRONG++;
+        else          l1d_bp_ctr_DEAD_OK++;
+    } else {
+        if ( reused ) l1d_bp_ctr_LIVE_OK++;
+        else          l1d_bp_ctr_LIVE_WRONG++;
+    }
+}
+
+cache_prefetcher::cache_prefetcher( unsigned line_sz, unsigned degree )
+: m_line_sz(line_sz), m_degree(degree), m_displaced(FILTER_SIZE, (new_addr_type)-1)
+{
+    assert( degree > 0 );
+}
+
+void cache_prefetcher::displaced( new_addr_type block_addr )
+{
+    m_displaced[ (block_addr / m_line_sz) % FILTER_SIZE ] = block_addr;
+}
+
+bool cache_prefetcher::polluted( new_addr_type block_addr )
+{
+    new_addr_type &slot = m_displaced[ (block_addr / m_line_sz) % FILTER_SIZE ];
+    if ( slot != block_addr )
+        return false;
+    slot = (new_addr_type)-1;
+    return true;
+}
+
+stride_prefetcher::stride_prefetcher( unsigned line_sz, unsigned degree, unsigned entries )
+: cache_prefetcher(line_sz, degree)
+{
+    assert( entries > 0 );
+    entry e;
+    e.m_pc = (address_type)-1;
+    e.m_last_addr = 0;
+    e.m_stride = 0;
+    e.m_conf = 0;
+    m_table.assign( entries, e );
+}
+
+void stride_prefetcher::observe( new_addr_type addr, address_type pc, bool miss, std::vector<new_addr_type> &candidates )
+{
+    if ( pc == (address_type)-1 )
+        return;
+    entry &e = m_table[ (pc >> 3) % m_table.size() ];
+    if ( e.m_pc != pc ) {
+        e.m_pc = pc;
+        e.m_last_addr = addr;
+        e.m_stride = 0;
+        e.m_conf = 0;
+        return;
+    }
+    long long stride = (long long)(addr - e.m_last_addr);
+    if ( stride == 0 )
+        return; // another access of the same warp instruction
+    if ( stride == e.m_stride ) {
+        if ( e.m_conf < CONF_MAX )
+            e.m_conf++;
+    } else if ( e.m_conf > 0 ) {
+        e.m_conf--;
+    } else {
+        e.m_stride = stride;
+    }
+    e.m_last_addr = addr;
+    if ( e.m_conf < CONF_THRESHOLD )
+        return;
+    // strides shorter than a line would name the same line several times
+    new_addr_type last = block_addr(addr);
+    for ( unsigned d=1; d <= m_degree; d++ ) {
+        new_addr_type target = block_addr( addr + d*e.m_stride );
+        if ( target != last )
+            candidates.push_back( target );
+        last = target;
+    }
+}
+
+void stream_prefetcher::observe( new_addr_type addr, address_type pc, bool miss, std::vector<new_addr_type> &candidates )
+{
+    if ( !miss )
+        return;
+    for ( unsigned d=1; d <= m_degree; d++ )
+        candidates.push_back( block_addr(addr) + d*m_line_sz );
 }
 
 // The l2 cache access function calls the base data_cache access
@@ -1191,7 +2588,7 @@ l2_cache::access( new_addr_type addr,
 enum cache_request_status tex_cache::access( new_addr_type addr, mem_fetch *mf,
     unsigned time, std::list<cache_event> &events )
 {
-    if ( m_fragment_fifo.full() || m_request_fifo.full() || m_rob.full() )
+    if ( m_fragment_fifo.full() || m_request_fifo.size() + m_hist_pending >= m_request_fifo.capacity() || m_rob.full() )
         return RESERVATION_FAIL;
 
     assert( mf->get_data_size() <= m_config.get_line_sz());
@@ -1199,7 +2596,7 @@ enum cache_request_status tex_cache::access( new_addr_type addr, mem_fetch *mf,
     // at this point, we will accept the request : access tags and immediately allocate line
     new_addr_type block_addr = m_config.block_addr(addr);
     unsigned cache_index = (unsigned)-1;
-    enum cache_request_status status = m_tags.access(block_addr,time,cache_index);
+    enum cache_request_status status = m_tags.access(block_addr,time,cache_index,mf);
     enum cache_request_status cache_status = RESERVATION_FAIL;
     assert( status != RESERVATION_FAIL );
     assert( status != HIT_RESERVED ); // as far as tags are concerned: HIT or MISS
@@ -1207,11 +2604,26 @@ enum cache_request_status tex_cache::access( new_addr_type addr, mem_fetch *mf,
     if ( status == MISS ) {
         // we need to send a memory request...
         unsigned rob_index = m_rob.push( rob_entry(cache_index, mf, block_addr) );
-        m_extra_mf_fields[mf] = extra_mf_fields(rob_index);
+        m_extra_mf_fields.insert(mf, extra_mf_fields(rob_index));
         mf->set_data_size(m_config.get_line_sz());
-        m_tags.fill(cache_index,time); // mark block as valid
-        m_request_fifo.push(mf);
-        mf->set_status(m_request_queue_status,time);
+        m_tags.fill(cache_index,time,m_config.full_sector_mask()); // mark block as valid
+    /// HIST
+        if( gpu_root != NULL && block_addr != 0 && !gpu_root->m_hist->bypass( m_core_id, mf ) ) {
+            unsigned home  = gpu_root->m_hist->get_home( mf->get_addr() );
+            unsigned NOC_d = gpu_root->m_hist->NOC_distance( m_core_id, home );
+
+            out_mf.push_back( mf );
+            mf->set_wait( NOC_d + 1, time, &m_hist_miss_queue );
+            mf->set_status(m_request_queue_status,time);
+            mf_stage( mf, MF_STAGE_HIST_NOC, time );
+            m_extra_mf_fields.find(mf)->m_hist = true;
+            m_hist_pending++;
+        } else {
+            m_request_fifo.push(mf);
+            mf->set_status(m_request_queue_status,time);
+            mf_stage( mf, m_request_queue_status, time );
+        }
+    /// HIST
         events.push_back(READ_REQUEST_SENT);
         cache_status = MISS;
     } else {
@@ -1223,8 +2635,16 @@ enum cache_request_status tex_cache::access( new_addr_type addr, mem_fetch *mf,
 }
 
 void tex_cache::cycle(){
-    // send next request to lower level of memory
-    if ( !m_request_fifo.empty() ) {
+    // send next request to lower level of memory; HIST fallbacks are older
+    if ( !m_hist_miss_queue.empty() ) {
+        mem_fetch *mf = m_hist_miss_queue.front();
+        if ( !m_memport->full(mf->get_ctrl_size(),false) ) {
+            m_hist_miss_queue.pop_front();
+            m_extra_mf_fields.find(mf)->m_hist = false;
+            m_hist_pending--;
+            m_memport->push(mf);
+        }
+    } else if ( !m_request_fifo.empty() ) {
         mem_fetch *mf = m_request_fifo.peek();
         if ( !m_memport->full(mf->get_ctrl_size(),false) ) {
             m_request_fifo.pop();
@@ -1262,18 +2682,76 @@ void tex_cache::cycle(){
 /// Place returning cache block into reorder buffer
 void tex_cache::fill( mem_fetch *mf, unsigned time )
 {
-    extra_mf_fields_lookup::iterator e = m_extra_mf_fields.find(mf);
-    assert( e != m_extra_mf_fields.end() );
-    assert( e->second.m_valid );
+    extra_mf_fields *e = m_extra_mf_fields.find(mf);
+    assert( e != NULL );
+    assert( e->m_valid );
     assert( !m_rob.empty() );
     mf->set_status(m_rob_status,time);
+    mf_stage( mf, m_rob_status, time );
 
-    unsigned rob_index = e->second.m_rob_index;
+    unsigned rob_index = e->m_rob_index;
+    if ( e->m_hist ) {
+        // forwarded by a HIST sharer
+        assert( m_hist_pending > 0 );
+        m_hist_pending--;
+    }
+    m_extra_mf_fields.erase(mf);
     rob_entry &r = m_rob.peek(rob_index);
     assert( !r.m_ready );
     r.m_ready = true;
     r.m_time = time;
     assert( r.m_block_addr == m_config.block_addr(mf->get_addr()) );
+
+/// HIST
+    if( gpu_root != NULL && r.m_block_addr != 0 )
+    {
+        unsigned home = gpu_root->m_hist->get_home( mf->get_addr() );
+
+        if( gpu_root->m_hist->probe( mf->get_addr() ) == HIST_HIT_WAIT && gpu_root->m_hist->check_in_range(m_core_id, home) ){
+            gpu_root->m_hist->ready( m_core_id, mf->get_addr(), time );
+            gpu_root->m_hist->fill_wait( m_core_id, mf->get_addr() );
+        }
+    }
+/// HIST
+}
+
+/// HIST Cycle
+void tex_cache::hist_cycle()
+{
+    std::list<mem_fetch*>::iterator it = out_mf.begin();
+    while( it != out_mf.end() ){
+        mem_fetch *mf_ptr = *it;
+        if( mf_ptr->get_wait() <= 1 ){
+            gpu_root->m_hist->probe_dest( mf_ptr->get_addr(), mf_ptr );
+            it = out_mf.erase( it );
+            continue;
+        }
+        mf_ptr->hist_cycle();
+        it++;
+    }
+}
+/// HIST Cycle
+
+void tex_cache::save_state( FILE *fp ) const
+{
+    m_tags.save_state(fp);
+    for ( unsigned i=0; i < m_config.get_num_lines(); i++ ) {
+        unsigned valid = m_cache[i].m_valid;
+        ckpt_write( fp, valid );
+        ckpt_write( fp, m_cache[i].m_block_addr );
+    }
+}
+
+void tex_cache::load_state( FILE *fp )
+{
+    assert( m_fragment_fifo.empty() && m_rob.empty() );
+    m_tags.load_state(fp);
+    for ( unsigned i=0; i < m_config.get_num_lines(); i++ ) {
+        unsigned valid;
+        ckpt_read( fp, valid );
+        ckpt_read( fp, m_cache[i].m_block_addr );
+        m_cache[i].m_valid = valid;
+    }
 }
 
 void tex_cache::display_state( FILE *fp ) const
@@ -60,43 +60,47 @@ enum cache_event {
 
 const char * cache_request_status_str(enum cache_request_status status); 
 
+// Checkpoint I/O: state is written field by field so that a checkpoint
+// does not depend on the in-memory layout of the cache structures
+template<class T> inline void ckpt_write( FILE *fp, const T &v )
+{
+    if( fwrite( &v, sizeof(T), 1, fp ) != 1 ) {
+        printf("GPGPU-Sim: error writing checkpoint\n");
+        abort();
+    }
+}
+template<class T> inline void ckpt_read( FILE *fp, T &v )
+{
+    if( fread( &v, sizeof(T), 1, fp ) != 1 ) {
+        printf("GPGPU-Sim: checkpoint file is truncated\n");
+        abort();
+    }
+}
+
+// Copy of one tag_array line, handed back to the cache on eviction
 struct cache_block_t {
     cache_block_t()
     {
-        m_tag=0;
         m_block_addr=0;
-        m_alloc_time=0;
-        m_fill_time=0;
-        m_last_access_time=0;
         m_status=INVALID;
-    }
-    void allocate( new_addr_type tag, new_addr_type block_addr, unsigned time )
-    {
-        m_tag=tag;
-        m_block_addr=block_addr;
-        m_alloc_time=time;
-        m_last_access_time=time;
-        m_fill_time=0;
-        m_status=RESERVED;
-    }
-    void fill( unsigned time )
-    {
-        assert( m_status == RESERVED );
-        m_status=VALID;
-        m_fill_time=time;
+        m_sector_dirty=0;
     }
 
-    new_addr_type    m_tag;
     new_addr_type    m_block_addr;
-    unsigned         m_alloc_time;
-    unsigned         m_last_access_time;
-    unsigned         m_fill_time;
     cache_block_state    m_status;
+    unsigned    m_sector_dirty;     // sectors to write back
 };
 
+// Lines are tracked in at most this many sectors (one bit each in a mask)
+#define MAX_CACHE_SECTORS 8
+
 enum replacement_policy_t {
     LRU,
-    FIFO
+    FIFO,
+    SRRIP,      // static re-reference interval prediction
+    BRRIP,      // bimodal RRIP: distant insertion, long one time in 32
+    DRRIP,      // set dueling between SRRIP and BRRIP
+    PLRU        // tree pseudo-LRU, power of two associativity
 };
 
 enum write_policy_t {
@@ -129,6 +133,35 @@ enum set_index_function{
     CUSTOM_SET_FUNCTION
 };
 
+enum set_hash_kind {
+    XOR_FOLD_HASH,          // "xor": block address folded onto the index bits
+    PRIME_MODULO_HASH,      // "prime": block address modulo the largest prime <= nset
+    BIT_PERMUTATION_HASH,   // "perm:<b0>,<b1>,...": index bit i is address bit b_i
+    XOR_MATRIX_HASH         // "matrix:<m0>,<m1>,...": index bit i is the parity of addr & m_i
+};
+
+/// Set index hash of the custom ('C') set index function, chosen by name from
+/// the registry in gpu-cache.cc. It is a plain value, so cache_config copies
+/// stay independent.
+class set_index_hash {
+public:
+    set_index_hash() : m_kind(XOR_FOLD_HASH), m_nset(1), m_nset_log2(0), m_line_sz_log2(0), m_prime(1) {}
+
+    /// Parse "<name>[:<args>]". Returns false if the name is unknown or the
+    /// arguments do not fit nset.
+    bool init( const char *spec, unsigned nset, unsigned line_sz_log2 );
+    unsigned index( new_addr_type addr ) const;
+
+private:
+    enum set_hash_kind m_kind;
+    unsigned m_nset;
+    unsigned m_nset_log2;
+    unsigned m_line_sz_log2;
+    unsigned m_prime;
+    std::vector<unsigned> m_bits;           // BIT_PERMUTATION_HASH
+    std::vector<new_addr_type> m_masks;     // XOR_MATRIX_HASH
+};
+
 class cache_config {
 public:
     cache_config() 
@@ -140,6 +173,12 @@ public:
         m_config_stringPrefShared = NULL;
         m_data_port_width = 0;
         m_set_index_function = LINEAR_SET_FUNCTION;
+        m_rrpv_bits = 2;
+        m_dueling_sets = 32;
+        m_sector_sz = 0; // set by option parser
+        m_set_hash_string = NULL; // set by option parser
+        m_compressed = false;
+        m_decompress_lat = 0;
     }
     void init(char * config, FuncCache status)
     {
@@ -148,11 +187,12 @@ public:
         char rp, wp, ap, mshr_type, wap, sif;
 
 
-        int ntok = sscanf(config,"%u:%u:%u,%c:%c:%c:%c:%c,%c:%u:%u,%u:%u,%u",
+        // optional trailing fields: data port width, RRPV bits and DRRIP leader sets per policy
+        int ntok = sscanf(config,"%u:%u:%u,%c:%c:%c:%c:%c,%c:%u:%u,%u:%u,%u,%u:%u",
                           &m_nset, &m_line_sz, &m_assoc, &rp, &wp, &ap, &wap,
                           &sif,&mshr_type,&m_mshr_entries,&m_mshr_max_merge,
                           &m_miss_queue_size, &m_result_fifo_entries,
-                          &m_data_port_width);
+                          &m_data_port_width, &m_rrpv_bits, &m_dueling_sets);
 
         if ( ntok < 11 ) {
             if ( !strcmp(config,"none") ) {
@@ -164,8 +204,16 @@ public:
         switch (rp) {
         case 'L': m_replacement_policy = LRU; break;
         case 'F': m_replacement_policy = FIFO; break;
+        case 'S': m_replacement_policy = SRRIP; break;
+        case 'B': m_replacement_policy = BRRIP; break;
+        case 'D': m_replacement_policy = DRRIP; break;
+        case 'P': m_replacement_policy = PLRU; break;
         default: exit_parse_error();
         }
+        if ( m_rrpv_bits < 1 || m_rrpv_bits > 8 ) 
+            exit_parse_error();
+        if ( m_replacement_policy == PLRU && ( m_assoc > 64 || (m_assoc & (m_assoc-1)) != 0 ) ) 
+            exit_parse_error();
         switch (wp) {
         case 'R': m_write_policy = READ_ONLY; break;
         case 'B': m_write_policy = WRITE_BACK; break;
@@ -184,6 +232,9 @@ public:
         case 'A': m_mshr_type = ASSOC; break;
         default: exit_parse_error();
         }
+        // the MSHR table indexes its ready ring and merge lists modulo these
+        if (m_mshr_type == ASSOC && (m_mshr_entries == 0 || m_mshr_max_merge == 0)) 
+            exit_parse_error();
         m_line_sz_log2 = LOGB2(m_line_sz);
         m_nset_log2 = LOGB2(m_nset);
         m_valid = true;
@@ -220,6 +271,41 @@ public:
         case 'L': m_set_index_function = LINEAR_SET_FUNCTION; break;
         default: exit_parse_error();
         }
+        if (m_set_index_function == CUSTOM_SET_FUNCTION) {
+            const char *spec = m_set_hash_string? m_set_hash_string : "xor";
+            if (!m_set_hash.init(spec, m_nset, m_line_sz_log2)) {
+                printf("GPGPU-Sim uArch: invalid set index hash \"%s\" for %u sets\n", spec, m_nset);
+                exit_parse_error();
+            }
+        }
+
+        // A sectored cache fetches only the missing sectors of a line. An
+        // unsectored one still tracks which 32B chunks of a line were used,
+        // for the fetched vs. used bytes statistic, but fills whole lines.
+        if (m_sector_sz) {
+            if (m_line_sz % m_sector_sz != 0 || m_line_sz / m_sector_sz > MAX_CACHE_SECTORS) 
+                assert(0 && "Invalid cache configuration: line size must be 1 to 8 sectors. ");
+            if (m_alloc_policy != ON_MISS) 
+                assert(0 && "Invalid cache configuration: a sectored cache must allocate on miss. ");
+            m_sector_bytes = m_sector_sz;
+        } else {
+            m_sector_bytes = (m_line_sz < 32)? m_line_sz : 32;
+            if (m_line_sz / m_sector_bytes > MAX_CACHE_SECTORS) 
+                m_sector_bytes = m_line_sz / MAX_CACHE_SECTORS;
+        }
+        m_num_sectors = m_line_sz / m_sector_bytes;
+
+        // A compressed cache has twice as many tags as its data array has
+        // uncompressed lines, and a set holds as many lines as fit in its
+        // m_data_assoc * m_line_sz bytes
+        m_data_assoc = m_assoc;
+        if (m_compressed) {
+            if (m_sector_sz || m_alloc_policy != ON_MISS) 
+                assert(0 && "Invalid cache configuration: a compressed cache must allocate whole lines on miss. ");
+            m_assoc *= 2;
+            if ( m_replacement_policy == PLRU && m_assoc > 64 ) 
+                exit_parse_error();
+        }
     }
     bool disabled() const { return m_disabled;}
     unsigned get_line_sz() const
@@ -232,19 +318,46 @@ public:
         assert( m_valid );
         return m_nset * m_assoc;
     }
+    bool sectored() const { return m_sector_sz != 0; }
+    bool compressed() const { return m_compressed; }
+    /// Data bytes of a set, which its compressed lines share
+    unsigned get_set_bytes() const { return m_data_assoc * m_line_sz; }
+    unsigned get_sector_sz() const { return m_sector_bytes; }
+    unsigned get_num_sectors() const { return m_num_sectors; }
+    unsigned full_sector_mask() const { return (1U << m_num_sectors) - 1; }
+    /// Sectors of a line touched by the bytes of this access
+    unsigned sector_mask( const mem_fetch *mf ) const
+    {
+        unsigned offset = mf->get_addr() & (m_line_sz-1);
+        unsigned size = mf->get_data_size();
+        if ( size == 0 || offset + size > m_line_sz ) 
+            return full_sector_mask();
+        unsigned first = offset / m_sector_bytes;
+        unsigned last = (offset + size - 1) / m_sector_bytes;
+        return ((1U << (last+1)) - 1) & ~((1U << first) - 1);
+    }
+    unsigned sector_bytes( unsigned mask ) const
+    {
+        unsigned n = 0;
+        for (; mask; mask &= mask-1) 
+            n++;
+        return n * m_sector_bytes;
+    }
 
     void print( FILE *fp ) const
     {
         fprintf( fp, "Size = %d B (%d Set x %d-way x %d byte line)\n", 
-                 m_line_sz * m_nset * m_assoc,
-                 m_nset, m_assoc, m_line_sz );
+                 m_line_sz * m_nset * m_data_assoc,
+                 m_nset, m_data_assoc, m_line_sz );
     }
 
     virtual unsigned set_index( new_addr_type addr ) const
     {
+        if(m_set_index_function == CUSTOM_SET_FUNCTION)
+            return m_set_hash.index(addr);
         if(m_set_index_function != LINEAR_SET_FUNCTION){
-            printf("\nGPGPU-Sim cache configuration error: Hashing or "
-                    "custom set index function selected in configuration "
+            printf("\nGPGPU-Sim cache configuration error: Hashing "
+                    "set index function selected in configuration "
                     "file for a cache that has not overloaded the set_index "
                     "function\n");
             abort();
@@ -269,6 +382,10 @@ public:
     char *m_config_string;
     char *m_config_stringPrefL1;
     char *m_config_stringPrefShared;
+    unsigned m_sector_sz;   // fill granularity, 0 = whole line
+    char *m_set_hash_string;    // custom set index hash, see set_index_hash
+    bool m_compressed;          // BDI compressed lines
+    unsigned m_decompress_lat;  // data port cycles added to a hit on a compressed line
     FuncCache cache_status;
 
 protected:
@@ -286,7 +403,9 @@ protected:
     unsigned m_nset_log2;
     unsigned m_assoc;
 
-    enum replacement_policy_t m_replacement_policy; // 'L' = LRU, 'F' = FIFO
+    enum replacement_policy_t m_replacement_policy; // 'L' = LRU, 'F' = FIFO, 'S'/'B'/'D' = SRRIP/BRRIP/DRRIP, 'P' = tree-PLRU
+    unsigned m_rrpv_bits;       // RRIP re-reference prediction value width
+    unsigned m_dueling_sets;    // DRRIP leader sets for each of SRRIP and BRRIP
     enum write_policy_t m_write_policy;             // 'T' = write through, 'B' = write back, 'R' = read only
     enum allocation_policy_t m_alloc_policy;        // 'm' = allocate on miss, 'f' = allocate on fill
     enum mshr_config_t m_mshr_type;
@@ -308,6 +427,10 @@ protected:
     unsigned m_result_fifo_entries;
     unsigned m_data_port_width; //< number of byte the cache can access per cycle 
     enum set_index_function m_set_index_function; // Hash, linear, or custom set index function
+    set_index_hash m_set_hash;                      // used by the custom set index function
+    unsigned m_sector_bytes;    // size of the sectors a line is tracked in
+    unsigned m_num_sectors;
+    unsigned m_data_assoc;      // uncompressed lines a set has room for, m_assoc unless compressed
 
     friend class tag_array;
     friend class baseline_cache;
@@ -334,6 +457,139 @@ private:
 	linear_to_raw_address_translation *m_address_mapping;
 };
 
+/// Per-SM L1D bypass predictor. A table of saturating counters indexed by
+/// load PC learns which loads bring in lines that are evicted without being
+/// hit again. Loads whose counter reaches the threshold skip L1D, except one
+/// in m_sample of them, which still fill a line to keep training the entry.
+class l1d_bypass_predictor {
+public:
+    l1d_bypass_predictor( unsigned entries, unsigned threshold, unsigned sample )
+    : m_ctr(entries, 0), m_threshold(threshold), m_sample(sample), m_sample_count(0)
+    {
+        assert( entries > 0 );
+        assert( threshold > 0 && threshold <= CTR_MAX );
+    }
+
+    unsigned signature( address_type pc ) const
+    {
+        return ( (pc >> 3) ^ (pc >> 13) ) % m_ctr.size();
+    }
+    bool predict_dead( address_type pc ) const { return m_ctr[signature(pc)] >= m_threshold; }
+    /// Decide whether this load skips L1D
+    bool bypass( address_type pc );
+    /// A line brought in by signature sig was evicted
+    void train( unsigned sig, bool reused, bool predicted_dead );
+
+private:
+    static const unsigned CTR_MAX = 7;  // 3-bit counters, high = no reuse
+
+    std::vector<unsigned char> m_ctr;
+    const unsigned m_threshold;
+    const unsigned m_sample;
+    unsigned m_sample_count;
+};
+
+/// Small fully associative buffer next to L1D that holds the lines L1D
+/// evicted, exclusive of L1D. A load that misses L1D but finds its line here
+/// swaps it back instead of going to memory. Entries are clean: a dirty line
+/// is still written back when it leaves L1D. Lookups are limited to m_ports
+/// per cycle.
+class l1d_victim_cache {
+public:
+    l1d_victim_cache( unsigned entries, unsigned ports );
+
+    /// Take one of this cycle's lookup ports
+    bool use_port( unsigned time );
+    /// Does the buffer hold these sectors of the line
+    bool probe( new_addr_type block_addr, unsigned sectors ) const;
+    /// Drop the line, returning its valid sectors (0 if absent)
+    unsigned remove( new_addr_type block_addr );
+    /// Take the line out to swap it back into L1D
+    void take( new_addr_type block_addr, unsigned &valid, unsigned &used );
+    /// Add a line evicted from L1D. Returns true, with the line it displaced,
+    /// if the buffer was full.
+    bool insert( new_addr_type block_addr, unsigned valid, unsigned used, new_addr_type &dropped );
+    void flush();
+
+    unsigned size() const { return m_entries.size(); }
+    bool valid( unsigned i ) const { return m_entries[i].m_valid != 0; }
+    new_addr_type get_block_addr( unsigned i ) const { return m_entries[i].m_block_addr; }
+
+private:
+    unsigned find( new_addr_type block_addr ) const;
+
+    struct entry {
+        new_addr_type m_block_addr;
+        unsigned m_valid;                   // valid sectors, 0 = empty
+        unsigned m_used;                    // sectors used while in L1D
+        unsigned long long m_stamp;         // insertion order, oldest is replaced
+    };
+    std::vector<entry> m_entries;
+    unsigned long long m_stamp;
+    const unsigned m_ports;
+    unsigned m_port_cycle;                  // cycle m_ports_used refers to
+    unsigned m_ports_used;
+};
+
+/// Hardware prefetcher attached to a cache. It watches the demand reads the
+/// cache sees and names the lines to bring in ahead of them. It also keeps a
+/// small filter of the lines its prefetches displaced, so that a demand miss
+/// on one of them can be counted as pollution.
+class cache_prefetcher {
+public:
+    cache_prefetcher( unsigned line_sz, unsigned degree );
+    virtual ~cache_prefetcher() {}
+
+    /// A demand read of addr by the load at pc, which missed if miss is set.
+    /// Appends the block addresses to prefetch to candidates.
+    virtual void observe( new_addr_type addr, address_type pc, bool miss, std::vector<new_addr_type> &candidates ) = 0;
+
+    /// A prefetch replaced the line at block_addr
+    void displaced( new_addr_type block_addr );
+    /// Demand miss on block_addr: was it displaced by a prefetch
+    bool polluted( new_addr_type block_addr );
+
+protected:
+    new_addr_type block_addr( new_addr_type addr ) const { return addr & ~(new_addr_type)(m_line_sz-1); }
+
+    const unsigned m_line_sz;
+    const unsigned m_degree;    // lines requested per trigger
+
+private:
+    static const unsigned FILTER_SIZE = 256;
+    std::vector<new_addr_type> m_displaced;   // direct mapped, (new_addr_type)-1 = empty
+};
+
+/// Per-PC stride prefetcher. Each load PC keeps the last address it read and
+/// the stride between its last two reads. Once the same stride has been seen
+/// CONF_THRESHOLD times in a row, every read of that PC prefetches the next
+/// m_degree strides ahead.
+class stride_prefetcher : public cache_prefetcher {
+public:
+    stride_prefetcher( unsigned line_sz, unsigned degree, unsigned entries );
+    virtual void observe( new_addr_type addr, address_type pc, bool miss, std::vector<new_addr_type> &candidates );
+
+private:
+    static const unsigned CONF_MAX = 3;
+    static const unsigned CONF_THRESHOLD = 2;
+
+    struct entry {
+        address_type m_pc;
+        new_addr_type m_last_addr;
+        long long m_stride;
+        unsigned m_conf;
+    };
+    std::vector<entry> m_table;     // direct mapped by pc
+};
+
+/// Next-N-line stream prefetcher: a demand miss prefetches the m_degree lines
+/// that follow it
+class stream_prefetcher : public cache_prefetcher {
+public:
+    stream_prefetcher( unsigned line_sz, unsigned degree ) : cache_prefetcher(line_sz, degree) {}
+    virtual void observe( new_addr_type addr, address_type pc, bool miss, std::vector<new_addr_type> &candidates );
+};
+
 class tag_array {
 public:
     // Use this constructor
@@ -341,44 +597,154 @@ public:
     ~tag_array();
 
     enum cache_request_status probe( new_addr_type addr, unsigned &idx ) const;
-    enum cache_request_status access( new_addr_type addr, unsigned time, unsigned &idx );
-    enum cache_request_status access( new_addr_type addr, unsigned time, unsigned &idx, bool &wb, cache_block_t &evicted );
+    enum cache_request_status probe( new_addr_type addr, unsigned &idx, unsigned sectors ) const;
+    enum cache_request_status access( new_addr_type addr, unsigned time, unsigned &idx, const mem_fetch *mf );
+    enum cache_request_status access( new_addr_type addr, unsigned time, unsigned &idx, bool &wb, cache_block_t &evicted, const mem_fetch *mf );
+    /// MSHR address of a miss on these sectors: the first sector of the fetch
+    /// that brings them in. On return, sectors holds what a new fetch reads.
+    new_addr_type fetch_addr( new_addr_type addr, unsigned idx, unsigned &sectors ) const;
 
     void fill( new_addr_type addr, unsigned time );
-    void fill( unsigned idx, unsigned time );
+    void fill( unsigned idx, unsigned time, unsigned sectors );
 
     unsigned size() const { return m_config.get_num_lines();}
-    cache_block_t &get_block(unsigned idx) { return m_lines[idx];}
+    new_addr_type get_block_addr( unsigned idx ) const { return m_tag[idx]; }
+    cache_block_state get_status( unsigned idx ) const { return m_status[idx]; }
+    void mark_dirty( unsigned idx, unsigned sectors );
+    void invalidate_sectors( unsigned idx, unsigned sectors );
+
+    // bypass predictor training, L1D only
+    void set_bypass_predictor( l1d_bypass_predictor *pred );
+    void set_signature( unsigned idx, unsigned sig, bool predicted_dead );
+
+    // victim cache, L1D only: evicted lines move there, and back on a hit
+    void set_victim_cache( l1d_victim_cache *victim )
+    {
+        assert( !m_config.compressed() );
+        m_victim = victim;
+    }
+    void victim_swap( new_addr_type addr, unsigned idx, unsigned time, unsigned sectors, bool &wb, cache_block_t &evicted );
+    void victim_invalidate( new_addr_type addr );
+    /// Whole line present, here or in the victim cache
+    bool holds( new_addr_type addr ) const;
+
+    // prefetching: lines brought in by a prefetch are flagged until first used
+    void track_prefetches();
+    int get_type_id() const { return m_type_id; }
+    bool prefetch( new_addr_type addr, unsigned idx, unsigned time, unsigned fetch, bool &wb, cache_block_t &evicted, new_addr_type &displaced, const mem_fetch *trigger );
 
     void flush(); // flash invalidate all entries
+    bool invalidate( new_addr_type addr ); // invalidate a single clean line
     void new_window();
 
     void print( FILE *stream, unsigned &total_access, unsigned &total_misses ) const;
     float windowed_miss_rate( ) const;
     void get_stats(unsigned &total_access, unsigned &total_misses, unsigned &total_hit_res, unsigned &total_res_fail) const;
+    void get_sector_stats(unsigned long long &fetched_bytes, unsigned long long &used_bytes) const
+    {
+        fetched_bytes = m_fetched_bytes;
+        used_bytes = m_used_bytes;
+    }
+
+    // compression: a read hit on a compressed line pays for decompression
+    bool decompress( unsigned idx );
+    /// Dirty lines evicted to make room for a compressed line, after the one
+    /// access() returned. Returns false once there are none left.
+    bool next_writeback( cache_block_t &evicted );
+    void get_compression_stats(unsigned long long &raw_bytes, unsigned long long &comp_bytes, unsigned long long &decompressions) const
+    {
+        raw_bytes = m_comp_raw_bytes;
+        comp_bytes = m_comp_bytes;
+        decompressions = m_decompressions;
+    }
+    /// Accesses to the busiest set over the mean per set, as the max, sum and
+    /// count (1, or 0 if never accessed) that cache_sub_stats combines
+    void get_set_stats(float &max_ratio, float &sum_ratio, unsigned &n_caches) const;
 
 	void update_cache_parameters(cache_config &config);
+
+    void save_state( FILE *fp ) const;
+    void load_state( FILE *fp );
 protected:
-    // This constructor is intended for use only from derived classes that wish to
-    // avoid unnecessary memory allocation that takes place in the
-    // other tag_array constructor
-    tag_array( cache_config &config,
-               int core_id,
-               int type_id,
-               cache_block_t* new_lines, gpgpu_sim *gpu );
     void init( int core_id, int type_id );
+    unsigned lookup( new_addr_type addr ) const;
+    bool resident( unsigned idx, new_addr_type addr ) const { return m_tag[idx] == m_config.tag(addr) && m_status[idx] != INVALID; }
+    void evict_line( unsigned idx );
+    void allocate_line( unsigned idx, new_addr_type tag, unsigned time, const mem_fetch *mf );
+    void reserve( new_addr_type addr, unsigned idx, unsigned time, unsigned fetch, bool &wb, cache_block_t &evicted, const mem_fetch *mf );
+    unsigned compressed_size( new_addr_type block_addr, const mem_fetch *mf ) const;
+    unsigned set_bytes( unsigned set_index, bool reserved_only ) const;
+    void make_room( unsigned idx );
+    void fill_line( unsigned idx, unsigned sectors );
+    void mark_used( unsigned idx, unsigned sectors );
+    // not replaceable: waiting for the fill of the whole line or of some sectors
+    bool reserved( unsigned idx ) const { return m_status[idx] == RESERVED || m_sector_pending[idx] != 0; }
+
+    // replacement policy state
+    unsigned victim( unsigned set_index ) const;
+    void touch( unsigned idx );
+    void insert( unsigned idx );
+    bool rrip() const
+    {
+        return m_config.m_replacement_policy == SRRIP || m_config.m_replacement_policy == BRRIP
+            || m_config.m_replacement_policy == DRRIP;
+    }
+    unsigned rrpv_max() const { return (1U << m_config.m_rrpv_bits) - 1; }
+    void rrip_age( unsigned idx );
+    enum replacement_policy_t duel( unsigned set_index );
 
 protected:
 
     cache_config &m_config;
     gpgpu_sim *gpu_root;
 
-    cache_block_t *m_lines; /* nbanks x nset x assoc lines in total */
+    // Line state for nbanks x nset x assoc lines, one array per field so that
+    // the hit check in probe() only reads the tags and status of one set.
+    // The tag is the full block address (see cache_config::tag).
+    new_addr_type     *m_tag;
+    cache_block_state *m_status;
+    unsigned          *m_last_access_time;  // LRU stamp
+    unsigned          *m_alloc_time;        // FIFO stamp
+    unsigned char     *m_rrpv;              // RRIP re-reference prediction value
+
+    // Sector masks, bit n is sector n of the line. Valid and pending are only
+    // kept per sector on a sectored cache; an unsectored line is all or nothing.
+    unsigned char     *m_sector_valid;
+    unsigned char     *m_sector_dirty;
+    unsigned char     *m_sector_pending;    // fetch in flight
+    unsigned char     *m_sector_used;       // read or written since allocation
+    unsigned char     *m_sector_fetch;      // first sector of the fetch bringing in each pending sector
+
+    std::vector<unsigned long long> m_plru; // tree-PLRU node bits per set, node n is bit n
+    std::vector<unsigned long long> m_set_accesses; // per set, to show set camping
+    unsigned m_psel;                        // DRRIP policy selector, BRRIP above half
+    unsigned m_brrip_count;                 // BRRIP inserts, every 32nd one is long
+
+    // Bypass predictor training state, only allocated with a predictor: load
+    // PC signature of each line, whether it was hit after allocation and
+    // whether it was a sampled line of a load predicted dead
+    l1d_bypass_predictor *m_bypass_pred;
+    unsigned *m_sig;
+    bool *m_reused;
+    bool *m_pred_dead;
+
+    l1d_victim_cache *m_victim;
+
+    bool *m_prefetched;     // brought in by a prefetch and not read since, NULL without a prefetcher
+
+    // Compressed size of each line in bytes, NULL unless the cache is compressed
+    unsigned short *m_comp_size;
+    std::list<cache_block_t> m_comp_wb;     // see next_writeback()
+    unsigned long long m_comp_raw_bytes;    // allocated lines, uncompressed
+    unsigned long long m_comp_bytes;        // the same lines, compressed
+    unsigned long long m_decompressions;
 
     unsigned m_access;
     unsigned m_miss;
     unsigned m_pending_hit; // number of cache miss that hit a line that is allocated but not filled
     unsigned m_res_fail;
+    unsigned long long m_fetched_bytes;
+    unsigned long long m_used_bytes;
 
     // performance counters for calculating the amount of misses within a time window
     unsigned m_prev_snapshot_access;
@@ -391,14 +757,7 @@ protected:
 
 class mshr_table {
 public:
-    mshr_table( unsigned num_entries, unsigned max_merged )
-    : m_num_entries(num_entries),
-    m_max_merged(max_merged)
-#if (tr1_hash_map_ismap == 0)
-    ,m_data(2*num_entries)
-#endif
-    {
-    }
+    mshr_table( unsigned num_entries, unsigned max_merged );
 
     /// Checks if there is a pending request to the lower memory level already
     bool probe( new_addr_type block_addr ) const;
@@ -410,12 +769,18 @@ public:
     bool busy() const {return false;}
     /// Accept a new cache fill response: mark entry ready for processing
     void mark_ready( new_addr_type block_addr, bool &has_atomic );
+    /// Fill response of the prefetch mf that opened this entry: drop it, and
+    /// mark the demand accesses merged behind it ready
+    void mark_ready_prefetch( new_addr_type block_addr, mem_fetch *mf, bool &has_atomic );
     /// Returns true if ready accesses exist
-    bool access_ready() const {return !m_current_response.empty();}
+    bool access_ready() const {return m_ready_count > 0;}
     /// Returns next ready access
     mem_fetch *next_access();
     void display( FILE *fp ) const;
 
+    void save_state( FILE *fp ) const;
+    void load_state( FILE *fp );
+
     void check_mshr_parameters( unsigned num_entries, unsigned max_merged )
     {
     	assert(m_num_entries==num_entries && "Change of MSHR parameters between kernels is not allowed");
@@ -424,21 +789,39 @@ public:
 
 private:
 
+    unsigned hash( new_addr_type block_addr ) const;
+    unsigned find_slot( new_addr_type block_addr ) const;
+    void release( unsigned entry );
+
     // finite sized, fully associative table, with a finite maximum number of merged requests
     const unsigned m_num_entries;
     const unsigned m_max_merged;
 
+    // Open addressing index (linear probing) from block address to entry.
+    // It has at least twice as many slots as entries, so probe runs stay short.
+    struct mshr_slot {
+        new_addr_type m_block_addr;
+        unsigned m_entry;           // (unsigned)-1 when the slot is empty
+    };
+    std::vector<mshr_slot> m_slots;
+    unsigned m_slot_bits;
+
+    // Entries never move while in use. The merged requests of entry e live in
+    // m_merged[e*m_max_merged ...] as a ring of m_count starting at m_head.
     struct mshr_entry {
-        std::list<mem_fetch*> m_list;
-        bool m_has_atomic; 
-        mshr_entry() : m_has_atomic(false) { }
-    }; 
-    typedef tr1_hash_map<new_addr_type,mshr_entry> table;
-    table m_data;
+        new_addr_type m_block_addr;
+        unsigned m_head;
+        unsigned m_count;
+        bool m_has_atomic;
+    };
+    std::vector<mshr_entry> m_entries;
+    std::vector<mem_fetch*> m_merged;
+    std::vector<unsigned> m_free;   // free entries, used as a stack
 
     // it may take several cycles to process the merged requests
-    bool m_current_response_ready;
-    std::list<new_addr_type> m_current_response;
+    std::vector<unsigned> m_ready;  // ring of entries with a fill response
+    unsigned m_ready_head;
+    unsigned m_ready_count;
 };
 
 
@@ -456,6 +839,18 @@ struct cache_sub_stats{
     unsigned long long data_port_busy_cycles; 
     unsigned long long fill_port_busy_cycles; 
 
+    unsigned long long fetched_bytes;   // brought in by fills
+    unsigned long long used_bytes;      // of those, in sectors that were accessed
+
+    unsigned long long comp_raw_bytes;  // lines allocated in a compressed cache
+    unsigned long long comp_bytes;      // their compressed size
+    unsigned long long decompressions;  // hits on compressed lines
+
+    // per cache: accesses to the busiest set over the mean per set
+    float set_imbalance_max;            // highest ratio of any cache
+    float set_imbalance_sum;            // sum of the ratios
+    unsigned set_imbalance_caches;      // caches with any access
+
     cache_sub_stats(){
         clear();
     }
@@ -467,6 +862,14 @@ struct cache_sub_stats{
         port_available_cycles = 0; 
         data_port_busy_cycles = 0; 
         fill_port_busy_cycles = 0; 
+        fetched_bytes = 0;
+        used_bytes = 0;
+        comp_raw_bytes = 0;
+        comp_bytes = 0;
+        decompressions = 0;
+        set_imbalance_max = 0;
+        set_imbalance_sum = 0;
+        set_imbalance_caches = 0;
     }
     cache_sub_stats &operator+=(const cache_sub_stats &css){
         ///
@@ -479,6 +882,15 @@ struct cache_sub_stats{
         port_available_cycles += css.port_available_cycles; 
         data_port_busy_cycles += css.data_port_busy_cycles; 
         fill_port_busy_cycles += css.fill_port_busy_cycles; 
+        fetched_bytes += css.fetched_bytes;
+        used_bytes += css.used_bytes;
+        comp_raw_bytes += css.comp_raw_bytes;
+        comp_bytes += css.comp_bytes;
+        decompressions += css.decompressions;
+        if (css.set_imbalance_max > set_imbalance_max) 
+            set_imbalance_max = css.set_imbalance_max;
+        set_imbalance_sum += css.set_imbalance_sum;
+        set_imbalance_caches += css.set_imbalance_caches;
         return *this;
     }
 
@@ -494,10 +906,21 @@ struct cache_sub_stats{
         ret.port_available_cycles = port_available_cycles + cs.port_available_cycles; 
         ret.data_port_busy_cycles = data_port_busy_cycles + cs.data_port_busy_cycles; 
         ret.fill_port_busy_cycles = fill_port_busy_cycles + cs.fill_port_busy_cycles; 
+        ret.fetched_bytes = fetched_bytes + cs.fetched_bytes;
+        ret.used_bytes = used_bytes + cs.used_bytes;
+        ret.comp_raw_bytes = comp_raw_bytes + cs.comp_raw_bytes;
+        ret.comp_bytes = comp_bytes + cs.comp_bytes;
+        ret.decompressions = decompressions + cs.decompressions;
+        ret.set_imbalance_max = (set_imbalance_max > cs.set_imbalance_max)? set_imbalance_max : cs.set_imbalance_max;
+        ret.set_imbalance_sum = set_imbalance_sum + cs.set_imbalance_sum;
+        ret.set_imbalance_caches = set_imbalance_caches + cs.set_imbalance_caches;
         return ret;
     }
 
     void print_port_stats(FILE *fout, const char *cache_name) const; 
+    void print_sector_stats(FILE *fout, const char *cache_name) const;
+    void print_compression_stats(FILE *fout, const char *cache_name) const;
+    void print_set_stats(FILE *fout, const char *cache_name) const;
 };
 
 ///
@@ -545,6 +968,85 @@ public:
 bool was_write_sent( const std::list<cache_event> &events );
 bool was_read_sent( const std::list<cache_event> &events );
 
+/// Open-addressing map from an in-flight mem_fetch to the fields a cache keeps
+/// for it until its fill returns. Sized once from the number of requests the
+/// cache can have outstanding and never allocates afterwards.
+template<class T> class mf_side_table {
+public:
+    mf_side_table( unsigned capacity ) : m_capacity(capacity), m_size(0) 
+    {
+        m_slot_bits = 1;
+        while ( (1U << m_slot_bits) < 2*capacity ) 
+            m_slot_bits++;
+        m_slots.resize( 1U << m_slot_bits );
+    }
+
+    /// Fields of mf, or NULL. The pointer is valid until the next insert or erase.
+    T *find( const mem_fetch *mf ) {
+        unsigned s = find_slot( mf );
+        return ( s == (unsigned)-1 )? NULL : &m_slots[s].m_value;
+    }
+    bool contains( const mem_fetch *mf ) const { return find_slot( mf ) != (unsigned)-1; }
+    void insert( const mem_fetch *mf, const T &value )
+    {
+        unsigned mask = m_slots.size() - 1;
+        unsigned s = hash( mf );
+        while ( m_slots[s].m_mf != NULL && m_slots[s].m_mf != mf ) 
+            s = (s+1) & mask;
+        if ( m_slots[s].m_mf == NULL ) {
+            assert( m_size < m_capacity );
+            m_size++;
+        }
+        m_slots[s].m_mf = mf;
+        m_slots[s].m_value = value;
+    }
+    /// Backward-shift deletion, so lookups never meet tombstones
+    void erase( const mem_fetch *mf )
+    {
+        unsigned mask = m_slots.size() - 1;
+        unsigned hole = find_slot( mf );
+        if ( hole == (unsigned)-1 ) 
+            return;
+        for ( unsigned s = (hole+1) & mask; m_slots[s].m_mf != NULL; s = (s+1) & mask ) {
+            unsigned home = hash( m_slots[s].m_mf );
+            if ( ((s - home) & mask) >= ((s - hole) & mask) ) {
+                m_slots[hole] = m_slots[s];
+                hole = s;
+            }
+        }
+        m_slots[hole].m_mf = NULL;
+        m_size--;
+    }
+    unsigned size() const { return m_size; }
+
+private:
+    struct slot {
+        slot() : m_mf(NULL) {}
+        const mem_fetch *m_mf;
+        T m_value;
+    };
+
+    unsigned hash( const mem_fetch *mf ) const
+    {
+        unsigned long long h = ((unsigned long long)(size_t)mf >> 4) * 0x9E3779B97F4A7C15ULL;
+        return (unsigned)(h >> (64 - m_slot_bits));
+    }
+    unsigned find_slot( const mem_fetch *mf ) const
+    {
+        unsigned mask = m_slots.size() - 1;
+        for ( unsigned s = hash(mf); ; s = (s+1) & mask ) {
+            if ( m_slots[s].m_mf == NULL ) 
+                return (unsigned)-1;
+            if ( m_slots[s].m_mf == mf ) 
+                return s;
+        }
+    }
+    std::vector<slot> m_slots;      // at least twice the capacity, a power of two
+    unsigned m_slot_bits;
+    unsigned m_capacity;
+    unsigned m_size;
+};
+
 /// Baseline cache
 /// Implements common functions for read_only_cache and data_cache
 /// Each subclass implements its own 'access' function
@@ -554,6 +1056,7 @@ public:
                      enum mem_fetch_status status, gpgpu_sim *gpu )
     : m_config(config), m_tag_array(new tag_array(config,core_id,type_id,gpu)), 
       m_mshrs(config.m_mshr_entries,config.m_mshr_max_merge), gpu_root(gpu), m_core_id(core_id),
+      m_extra_mf_fields(config.m_mshr_entries*config.m_mshr_max_merge),
       m_bandwidth_management(config) 
     {
         init( name, config, memport, status );
@@ -568,6 +1071,7 @@ public:
         assert(config.m_mshr_type == ASSOC);
         m_memport=memport;
         m_miss_queue_status = status;
+        m_prefetcher = NULL;
     }
 
     virtual ~baseline_cache()
@@ -607,14 +1111,30 @@ public:
     }
     void get_sub_stats(struct cache_sub_stats &css) const {
         m_stats.get_sub_stats(css);
+        m_tag_array->get_sector_stats(css.fetched_bytes, css.used_bytes);
+        m_tag_array->get_compression_stats(css.comp_raw_bytes, css.comp_bytes, css.decompressions);
+        m_tag_array->get_set_stats(css.set_imbalance_max, css.set_imbalance_sum, css.set_imbalance_caches);
     }
 
     // accessors for cache bandwidth availability 
     bool data_port_free() const { return m_bandwidth_management.data_port_free(); } 
     bool fill_port_free() const { return m_bandwidth_management.fill_port_free(); } 
 
+    void save_state( FILE *fp ) const { m_tag_array->save_state(fp); m_mshrs.save_state(fp); }
+    void load_state( FILE *fp ) { m_tag_array->load_state(fp); m_mshrs.load_state(fp); }
+
+    /// Only a data_cache issues prefetches. Lines must be allocated on miss.
+    void set_prefetcher( cache_prefetcher *pf )
+    {
+        assert( m_prefetcher == NULL && m_config.m_alloc_policy == ON_MISS );
+        m_prefetcher = pf;
+        m_tag_array->track_prefetches();
+    }
+
     void hist_cycle();
     void print_out_mf();
+    bool invalidate( new_addr_type addr ){ return m_tag_array->invalidate( m_config.block_addr(addr) ); }
+    bool holds( new_addr_type addr ) const { return m_tag_array->holds( m_config.block_addr(addr) ); }
 protected:
     // Constructor that can be used by derived classes with custom tag arrays
     baseline_cache( const char *name,
@@ -627,7 +1147,9 @@ protected:
     : m_config(config),
       m_tag_array( new_tag_array ),
       m_mshrs(config.m_mshr_entries,config.m_mshr_max_merge), 
-      m_bandwidth_management(config), gpu_root(gpu), m_core_id(core_id)
+      gpu_root(gpu), m_core_id(core_id),
+      m_extra_mf_fields(config.m_mshr_entries*config.m_mshr_max_merge),
+      m_bandwidth_management(config)
     {
         init( name, config, memport, status );
     }
@@ -643,23 +1165,32 @@ protected:
     gpgpu_sim *gpu_root;
     const int m_core_id;
     std::list<mem_fetch*> out_mf;
+    cache_prefetcher *m_prefetcher;     // NULL if off
 
     struct extra_mf_fields {
         extra_mf_fields()  { m_valid = false;}
-        extra_mf_fields( new_addr_type a, unsigned i, unsigned d ) 
+        extra_mf_fields( new_addr_type a, unsigned i, new_addr_type r, unsigned d, new_addr_type m, unsigned s, bool p = false ) 
         {
             m_valid = true;
             m_block_addr = a;
             m_cache_index = i;
+            m_addr = r;
             m_data_size = d;
+            m_mshr_addr = m;
+            m_sectors = s;
+            m_prefetch = p;
         }
         bool m_valid;
         new_addr_type m_block_addr;
         unsigned m_cache_index;
-        unsigned m_data_size;
+        new_addr_type m_addr;       // address and size the request was made with,
+        unsigned m_data_size;       // given back to it at the fill
+        new_addr_type m_mshr_addr;  // block address, or sector address on a sectored cache
+        unsigned m_sectors;         // sectors fetched
+        bool m_prefetch;            // issued by m_prefetcher, ends at the fill
     };
 
-    typedef std::map<mem_fetch*,extra_mf_fields> extra_mf_fields_lookup;
+    typedef mf_side_table<extra_mf_fields> extra_mf_fields_lookup;
 
     extra_mf_fields_lookup m_extra_mf_fields;
 
@@ -675,6 +1206,8 @@ protected:
     /// Read miss handler. Check MSHR hit or MSHR available
     void send_read_request(new_addr_type addr, new_addr_type block_addr, unsigned cache_index, mem_fetch *mf,
     		unsigned time, bool &do_miss, bool &wb, cache_block_t &evicted, std::list<cache_event> &events, bool read_only, bool wa);
+    /// HIST: send a read miss to its home instead of the miss queue
+    bool hist_send( mem_fetch *mf, new_addr_type block_addr, unsigned time );
 
     /// Sub-class containing all metadata for port bandwidth management 
     class bandwidth_management 
@@ -688,6 +1221,9 @@ protected:
         /// use the fill port 
         void use_fill_port(mem_fetch *mf); 
 
+        /// hold the data port while a compressed line is decompressed 
+        void use_decompressor(); 
+
         /// called every cache cycle to free up the ports 
         void replenish_port_bandwidth(); 
 
@@ -820,6 +1356,12 @@ protected:
                              cache_event request,
                              unsigned time,
                              std::list<cache_event> &events);
+    /// Prefetch the line at block_addr on behalf of the demand read trigger
+    void issue_prefetch( new_addr_type block_addr, const mem_fetch *trigger, unsigned time );
+    /// Write back the dirty lines a compressed tag array evicted to make room
+    void send_compression_writebacks( unsigned time, std::list<cache_event> &events );
+    /// Write back the dirty sectors of an evicted line
+    void send_writeback( const cache_block_t &evicted, unsigned time, std::list<cache_event> &events );
 
     // Member Function pointers - Set by configuration options
     // to the functions below each grouping
@@ -934,7 +1476,8 @@ public:
     l1_cache(const char *name, cache_config &config,
             int core_id, int type_id, mem_fetch_interface *memport,
             mem_fetch_allocator *mfcreator, enum mem_fetch_status status, gpgpu_sim *gpu )
-            : data_cache(name,config,core_id,type_id,memport,mfcreator,status, L1_WR_ALLOC_R, L1_WRBK_ACC, gpu){}
+            : data_cache(name,config,core_id,type_id,memport,mfcreator,status, L1_WR_ALLOC_R, L1_WRBK_ACC, gpu),
+              m_bypass_pred(NULL), m_victim(NULL) {}
 
     virtual ~l1_cache(){}
 
@@ -944,6 +1487,17 @@ public:
                 unsigned time,
                 std::list<cache_event> &events );
 
+    void set_bypass_predictor( l1d_bypass_predictor *pred )
+    {
+        m_bypass_pred = pred;
+        m_tag_array->set_bypass_predictor( pred );
+    }
+    void set_victim_cache( l1d_victim_cache *victim )
+    {
+        m_victim = victim;
+        m_tag_array->set_victim_cache( victim );
+    }
+
 protected:
     l1_cache( const char *name,
               cache_config &config,
@@ -955,8 +1509,13 @@ protected:
               tag_array* new_tag_array, gpgpu_sim *gpu )
     : data_cache( name,
                   config,
-                  core_id,type_id,memport,mfcreator,status, new_tag_array, L1_WR_ALLOC_R, L1_WRBK_ACC, gpu ){}
+                  core_id,type_id,memport,mfcreator,status, new_tag_array, L1_WR_ALLOC_R, L1_WRBK_ACC, gpu ),
+      m_bypass_pred(NULL), m_victim(NULL) {}
+
+    enum cache_request_status victim_access( new_addr_type addr, mem_fetch *mf, unsigned time, std::list<cache_event> &events );
 
+    l1d_bypass_predictor *m_bypass_pred;
+    l1d_victim_cache *m_victim;
 };
 
 /// Models second level shared cache with global write-back
@@ -988,15 +1547,18 @@ class tex_cache : public cache_t {
 public:
     tex_cache( const char *name, cache_config &config, int core_id, int type_id, mem_fetch_interface *memport,
                enum mem_fetch_status request_status, 
-               enum mem_fetch_status rob_status )
+               enum mem_fetch_status rob_status, gpgpu_sim *gpu )
     : m_config(config), 
-    m_tags(config,core_id,type_id,NULL), 
+    m_tags(config,core_id,type_id,gpu), 
     m_fragment_fifo(config.m_fragment_fifo_entries), 
     m_request_fifo(config.m_request_fifo_entries),
     m_rob(config.m_rob_entries),
-    m_result_fifo(config.m_result_fifo_entries)
+    m_result_fifo(config.m_result_fifo_entries),
+    m_extra_mf_fields(config.m_rob_entries),
+    gpu_root(gpu), m_core_id(core_id)
     {
         m_name = name;
+        m_hist_pending = 0;
         assert(config.m_mshr_type == TEX_FIFO);
         assert(config.m_write_policy == READ_ONLY);
         assert(config.m_alloc_policy == ON_MISS);
@@ -1035,6 +1597,20 @@ public:
 
     void get_sub_stats(struct cache_sub_stats &css) const{
         m_stats.get_sub_stats(css);
+        m_tags.get_sector_stats(css.fetched_bytes, css.used_bytes);
+        m_tags.get_set_stats(css.set_imbalance_max, css.set_imbalance_sum, css.set_imbalance_caches);
+    }
+
+    void save_state( FILE *fp ) const;
+    void load_state( FILE *fp );
+
+    void hist_cycle();
+    /// Tags are filled at access time, so a line is only held once its data
+    /// has come out of the reorder buffer
+    bool holds( new_addr_type addr ) const {
+        unsigned idx;
+        new_addr_type block_addr = m_config.block_addr(addr);
+        return m_tags.probe( block_addr, idx ) == HIT && m_cache[idx].m_valid && m_cache[idx].m_block_addr == block_addr;
     }
 private:
     std::string m_name;
@@ -1154,16 +1730,27 @@ private:
         {
             m_valid = true;
             m_rob_index = i;
+            m_hist = false;
         }
         bool m_valid;
         unsigned m_rob_index;
+        bool m_hist;        // probing HIST, or back in m_hist_miss_queue
     };
 
     cache_stats m_stats;
 
-    typedef std::map<mem_fetch*,extra_mf_fields> extra_mf_fields_lookup;
+    typedef mf_side_table<extra_mf_fields> extra_mf_fields_lookup;
 
     extra_mf_fields_lookup m_extra_mf_fields;
+
+    // HIST: misses probing a home bypass m_request_fifo; the ones that
+    // fall back to L2 return through m_hist_miss_queue. Until they leave
+    // for L2 or are filled they hold one of the m_request_fifo slots
+    gpgpu_sim *gpu_root;
+    const int m_core_id;
+    std::list<mem_fetch*> out_mf;
+    std::list<mem_fetch*> m_hist_miss_queue;
+    unsigned m_hist_pending;
 };
 
 #endif
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "zlib.h"
 
 
@@ -92,7 +93,62 @@ unsigned long long hist_ctr_GPROBE_S = 0;
 unsigned long long hist_ctr_GPROBE_F = 0;
 unsigned long long hist_ctr_FILL = 0;
 unsigned long long hist_ctr_FILL_TIME = 0;
+unsigned long long hist_ctr_BYPASS_LOCAL = 0;
+unsigned long long hist_ctr_BYPASS_PRIVATE = 0;
+unsigned long long hist_ctr_BYPASS_ALLOC = 0;
+unsigned long long hist_ctr_PAGE_PRIVATE = 0;
+unsigned long long hist_ctr_PAGE_SHARED_RO = 0;
+unsigned long long hist_ctr_PAGE_SHARED_RW = 0;
+unsigned long long hist_ctr_INV_WRITE = 0;
+unsigned long long hist_ctr_INV_MSG = 0;
+unsigned long long hist_ctr_INV_HOPS = 0;
+unsigned long long hist_ctr_INV_HIT = 0;
+unsigned long long hist_ctr_INV_WAIT = 0;
+unsigned long long hist_ctr_ATOM_NEAR = 0;
+unsigned long long hist_ctr_ATOM_L2 = 0;
+unsigned long long hist_ctr_ATOM_LAT = 0;
+unsigned long long hist_ctr_ATOM_QUEUE = 0;
+unsigned long long hist_ctr_EVICT_MSG = 0;
+unsigned long long hist_ctr_EVICT_BATCH = 0;
+unsigned long long hist_ctr_STALE = 0;
+unsigned long long hist_ctr_STALE_LAT = 0;
+unsigned long long hist_ctr_EVICT_STALE = 0;
+unsigned long long hist_ctr_RETRY = 0;
+unsigned long long hist_ctr_RETRY_OK = 0;
+unsigned long long hist_ctr_RETRY_FAIL = 0;
+unsigned long long hist_ctr_RETRY_LAT = 0;
+unsigned long long hist_ctr_TABLE_ACCESS = 0;
+unsigned long long hist_ctr_MERGE = 0;
+unsigned long long hist_ctr_MERGE_TXN = 0;
+unsigned long long hist_ctr_EJECT = 0;
+unsigned long long hist_ctr_EJECT_STALL = 0;
+unsigned long long hist_ctr_EJECT_BP = 0;
+unsigned long long hist_ctr_CONST_TOT = 0;
+unsigned long long hist_ctr_CONST_FWD = 0;
+unsigned long long hist_ctr_TEX_TOT = 0;
+unsigned long long hist_ctr_TEX_FWD = 0;
+unsigned long long hist_ctr_EPOCH = 0;
+unsigned long long hist_ctr_EPOCH_DROP = 0;
+unsigned long long l1d_bp_ctr_BYPASS = 0;
+unsigned long long l1d_bp_ctr_SAMPLE = 0;
+unsigned long long l1d_bp_ctr_DEAD_OK = 0;
+unsigned long long l1d_bp_ctr_DEAD_WRONG = 0;
+unsigned long long l1d_bp_ctr_LIVE_OK = 0;
+unsigned long long l1d_bp_ctr_LIVE_WRONG = 0;
+unsigned long long l1d_vc_ctr_HIT = 0;
+unsigned long long l1d_vc_ctr_MISS = 0;
+unsigned long long l1d_vc_ctr_PORT_STALL = 0;
+unsigned long long l1d_vc_ctr_SWAP_STALL = 0;
+unsigned long long l1d_vc_ctr_DROP = 0;
+unsigned long long l1d_pf_ctr_ISSUED = 0;
+unsigned long long l1d_pf_ctr_DROP = 0;
+unsigned long long l1d_pf_ctr_USEFUL = 0;
+unsigned long long l1d_pf_ctr_LATE = 0;
+unsigned long long l1d_pf_ctr_UNUSED = 0;
+unsigned long long l1d_pf_ctr_POLLUTION = 0;
 unsigned long long *set_distribute;
+mf_stage_stats *g_mf_stage_stats = NULL;
+const memory_space *g_cache_data = NULL;
 
 // performance counter for stalls due to congestion.
 unsigned int gpu_stall_dramfull = 0; 
@@ -163,6 +219,18 @@ void memory_config::reg_options(class OptionParser * opp)
                    "unified banked L2 data cache config "
                    " {<nsets>:<bsize>:<assoc>,<rep>:<wr>:<alloc>:<wr_alloc>,<mshr>:<N>:<merge>,<mq>}",
                    "64:128:8,L:B:m:N,A:16:4,4");
+    option_parser_register(opp, "-gpgpu_cache:dl2_set_hash", OPT_CSTR, &m_L2_config.m_set_hash_string, 
+                   "custom (C) set index hash of the L2 data cache: xor, prime, perm:<bit>,... or matrix:<mask>,... (one entry per index bit)",
+                   "xor");
+    option_parser_register(opp, "-gpgpu_cache:dl2_sector_sz", OPT_UINT32, &m_L2_config.m_sector_sz, 
+                   "L2 data cache sector size in bytes, misses fetch only the missing sectors (0 = whole line)",
+                   "0");
+    option_parser_register(opp, "-gpgpu_cache:dl2_compress", OPT_BOOL, &m_L2_config.m_compressed, 
+                   "BDI compressed L2 data cache: twice the tags, lines share the bytes of their set",
+                   "0");
+    option_parser_register(opp, "-gpgpu_cache:dl2_decompress_lat", OPT_UINT32, &m_L2_config.m_decompress_lat, 
+                   "L2 data port cycles to decompress a compressed line on a hit",
+                   "1");
     option_parser_register(opp, "-gpgpu_cache:dl2_texture_only", OPT_BOOL, &m_L2_texure_only, 
                            "L2 cache used for texture only",
                            "1");
@@ -217,18 +285,39 @@ void shader_core_config::reg_options(class OptionParser * opp)
                    "per-shader L1 texture cache  (READ-ONLY) config "
                    " {<nsets>:<bsize>:<assoc>,<rep>:<wr>:<alloc>:<wr_alloc>,<mshr>:<N>:<merge>,<mq>:<rf>}",
                    "8:128:5,L:R:m:N,F:128:4,128:2");
+    option_parser_register(opp, "-gpgpu_tex_cache:l1_set_hash", OPT_CSTR, &m_L1T_config.m_set_hash_string, 
+                   "custom (C) set index hash of the L1 texture cache: xor, prime, perm:<bit>,... or matrix:<mask>,... (one entry per index bit)",
+                   "xor");
     option_parser_register(opp, "-gpgpu_const_cache:l1", OPT_CSTR, &m_L1C_config.m_config_string, 
                    "per-shader L1 constant memory cache  (READ-ONLY) config "
                    " {<nsets>:<bsize>:<assoc>,<rep>:<wr>:<alloc>:<wr_alloc>,<mshr>:<N>:<merge>,<mq>} ",
                    "64:64:2,L:R:f:N,A:2:32,4" );
+    option_parser_register(opp, "-gpgpu_const_cache:l1_set_hash", OPT_CSTR, &m_L1C_config.m_set_hash_string, 
+                   "custom (C) set index hash of the L1 constant cache: xor, prime, perm:<bit>,... or matrix:<mask>,... (one entry per index bit)",
+                   "xor" );
     option_parser_register(opp, "-gpgpu_cache:il1", OPT_CSTR, &m_L1I_config.m_config_string, 
                    "shader L1 instruction cache config "
                    " {<nsets>:<bsize>:<assoc>,<rep>:<wr>:<alloc>:<wr_alloc>,<mshr>:<N>:<merge>,<mq>} ",
                    "4:256:4,L:R:f:N,A:2:32,4" );
+    option_parser_register(opp, "-gpgpu_cache:il1_set_hash", OPT_CSTR, &m_L1I_config.m_set_hash_string, 
+                   "custom (C) set index hash of the L1 instruction cache: xor, prime, perm:<bit>,... or matrix:<mask>,... (one entry per index bit)",
+                   "xor" );
     option_parser_register(opp, "-gpgpu_cache:dl1", OPT_CSTR, &m_L1D_config.m_config_string,
                    "per-shader L1 data cache config "
                    " {<nsets>:<bsize>:<assoc>,<rep>:<wr>:<alloc>:<wr_alloc>,<mshr>:<N>:<merge>,<mq> | none}",
                    "none" );
+    option_parser_register(opp, "-gpgpu_cache:dl1_set_hash", OPT_CSTR, &m_L1D_config.m_set_hash_string,
+                   "custom (C) set index hash of the L1 data cache: xor, prime, perm:<bit>,... or matrix:<mask>,... (one entry per index bit)",
+                   "xor" );
+    option_parser_register(opp, "-gpgpu_cache:dl1_sector_sz", OPT_UINT32, &m_L1D_config.m_sector_sz,
+                   "L1 data cache sector size in bytes, misses fetch only the missing sectors (0 = whole line)",
+                   "0" );
+    option_parser_register(opp, "-gpgpu_cache:dl1_compress", OPT_BOOL, &m_L1D_config.m_compressed,
+                   "BDI compressed L1 data cache: twice the tags, lines share the bytes of their set",
+                   "0" );
+    option_parser_register(opp, "-gpgpu_cache:dl1_decompress_lat", OPT_UINT32, &m_L1D_config.m_decompress_lat,
+                   "L1 data port cycles to decompress a compressed line on a hit",
+                   "1" );
     option_parser_register(opp, "-gpgpu_cache:dl1PrefL1", OPT_CSTR, &m_L1D_config.m_config_stringPrefL1,
                    "per-shader L1 data cache config "
                    " {<nsets>:<bsize>:<assoc>,<rep>:<wr>:<alloc>:<wr_alloc>,<mshr>:<N>:<merge>,<mq> | none}",
@@ -240,6 +329,30 @@ void shader_core_config::reg_options(class OptionParser * opp)
     option_parser_register(opp, "-gmem_skip_L1D", OPT_BOOL, &gmem_skip_L1D, 
                    "global memory access skip L1D cache (implements -Xptxas -dlcm=cg, default=no skip)",
                    "0");
+    option_parser_register(opp, "-gpgpu_l1d_bypass_pred", OPT_UINT32, &gpgpu_l1d_bypass_pred, 
+                   "entries of the per-SM PC-indexed L1D bypass predictor (0 = off)",
+                   "0");
+    option_parser_register(opp, "-gpgpu_l1d_bypass_pred_threshold", OPT_UINT32, &gpgpu_l1d_bypass_pred_threshold, 
+                   "no-reuse counter value (1-7) at which loads of a PC bypass L1D",
+                   "6");
+    option_parser_register(opp, "-gpgpu_l1d_bypass_pred_sample", OPT_UINT32, &gpgpu_l1d_bypass_pred_sample, 
+                   "one in this many predicted-bypass loads still fills L1D to keep training (0 = never)",
+                   "32");
+    option_parser_register(opp, "-gpgpu_l1d_victim_entries", OPT_UINT32, &gpgpu_l1d_victim_entries, 
+                   "lines in the per-SM fully associative L1D victim cache (0 = off)",
+                   "0");
+    option_parser_register(opp, "-gpgpu_l1d_victim_ports", OPT_UINT32, &gpgpu_l1d_victim_ports, 
+                   "L1D victim cache lookups per cycle",
+                   "1");
+    option_parser_register(opp, "-gpgpu_l1d_prefetcher", OPT_CSTR, &gpgpu_l1d_prefetcher, 
+                   "per-SM L1D prefetcher {none | stride | stream}",
+                   "none");
+    option_parser_register(opp, "-gpgpu_l1d_prefetch_degree", OPT_UINT32, &gpgpu_l1d_prefetch_degree, 
+                   "lines the L1D prefetcher requests ahead of each trigger",
+                   "2");
+    option_parser_register(opp, "-gpgpu_l1d_prefetch_table", OPT_UINT32, &gpgpu_l1d_prefetch_table, 
+                   "entries of the PC-indexed stride prefetcher table",
+                   "64");
 
     option_parser_register(opp, "-gpgpu_perfect_mem", OPT_BOOL, &gpgpu_perfect_mem, 
                  "enable perfect memory mode (no cache miss)",
@@ -401,6 +514,51 @@ void gpgpu_sim_config::reg_options(option_parser_t opp)
    option_parser_register(opp, "-gpgpu_hist_age", OPT_INT32, &gpu_hist_age, 
                "Number of neighbhor width HIST table (default = 0)",
                "0");
+   option_parser_register(opp, "-gpgpu_hist_page_sz", OPT_INT32, &gpu_hist_page_sz, 
+               "Page size in bytes of HIST sharing classifier, private pages bypass HIST (default = 0, disabled)",
+               "0");
+   option_parser_register(opp, "-gpgpu_hist_atomic", OPT_INT32, &gpu_hist_atomic, 
+               "Execute atomics at the HIST home when the line is READY there (default = 0)",
+               "0");
+   option_parser_register(opp, "-gpgpu_hist_atomic_lat", OPT_INT32, &gpu_hist_atomic_lat, 
+               "Latency of one near-data atomic at the HIST home (default = 4)",
+               "4");
+   option_parser_register(opp, "-gpgpu_hist_evict_notify", OPT_INT32, &gpu_hist_evict_notify, 
+               "Send L1D eviction notifications to the HIST home over the NoC instead of updating it instantly (default = 0)",
+               "0");
+   option_parser_register(opp, "-gpgpu_hist_evict_batch", OPT_INT32, &gpu_hist_evict_batch, 
+               "Eviction notifications batched per SM before sending, 0 or 1 sends each one (default = 0)",
+               "0");
+   option_parser_register(opp, "-gpgpu_hist_retry_size", OPT_INT32, &gpu_hist_retry_size, 
+               "Entries of the per-home retry buffer for HIST_FULL requests (default = 0, fall back at once)",
+               "0");
+   option_parser_register(opp, "-gpgpu_hist_retry_wait", OPT_INT32, &gpu_hist_retry_wait, 
+               "Cycles a HIST_FULL request may wait in the retry buffer before falling back (default = 8)",
+               "8");
+   option_parser_register(opp, "-gpgpu_hist_coalesce", OPT_INT32, &gpu_hist_coalesce, 
+               "Merge same-line probes waiting at a home into one table access (default = 0)",
+               "0");
+   option_parser_register(opp, "-gpgpu_hist_eject_size", OPT_INT32, &gpu_hist_eject_size, 
+               "Entries of the per-cluster HIST ejection port (default = 0, unbounded direct push)",
+               "0");
+   option_parser_register(opp, "-gpgpu_hist_eject_width", OPT_INT32, &gpu_hist_eject_width, 
+               "HIST responses moved from the ejection port into the cluster response fifo per cycle (default = 1)",
+               "1");
+   option_parser_register(opp, "-gpgpu_hist_access_energy", OPT_DOUBLE, &gpu_hist_access_energy, 
+               "Energy of one HIST table access in pJ (default = 0)",
+               "0");
+   option_parser_register(opp, "-gpgpu_hist_const", OPT_INT32, &gpu_hist_const, 
+               "Forward constant cache (L1C) misses through HIST (default = 0)",
+               "0");
+   option_parser_register(opp, "-gpgpu_hist_tex", OPT_INT32, &gpu_hist_tex, 
+               "Forward texture cache (L1T) misses through HIST (default = 0)",
+               "0");
+   option_parser_register(opp, "-gpgpu_hist_boundary", OPT_INT32, &gpu_hist_boundary, 
+               "HIST state once no kernel is running: 0 = retain, 1 = flush, 2 = age (default = 0)",
+               "0");
+   option_parser_register(opp, "-gpgpu_hist_boundary_age", OPT_INT32, &gpu_hist_boundary_age, 
+               "Idle boundaries an untouched HIST entry survives with -gpgpu_hist_boundary 2 (default = 1)",
+               "1");
 // Pisacha: HIST Config
    option_parser_register(opp, "-gpgpu_max_cycle", OPT_INT32, &gpu_max_cycle_opt, 
                "terminates gpu simulation early (0 = no limit)",
@@ -423,6 +581,18 @@ void gpgpu_sim_config::reg_options(option_parser_t opp)
    option_parser_register(opp, "-gpgpu_flush_l2_cache", OPT_BOOL, &gpgpu_flush_l2_cache,
                    "Flush L2 cache at the end of each kernel call",
                    "0");
+   option_parser_register(opp, "-gpgpu_ckpt_save", OPT_CSTR, &gpgpu_ckpt_save,
+                   "Checkpoint cache and HIST state to this file at the end of a kernel (empty = off)",
+                   "");
+   option_parser_register(opp, "-gpgpu_ckpt_load", OPT_CSTR, &gpgpu_ckpt_load,
+                   "Restore cache and HIST state from this file before the first kernel (empty = off)",
+                   "");
+   option_parser_register(opp, "-gpgpu_mf_stage_stats", OPT_INT32, &gpgpu_mf_stage_stats,
+                   "Per-stage memory request latency histograms (0 = off, 1 = per access type, 2 = also per SM)",
+                   "0");
+   option_parser_register(opp, "-gpgpu_ckpt_kernel", OPT_INT32, &gpgpu_ckpt_kernel,
+                   "Kernel uid after which -gpgpu_ckpt_save is written (0 = after every kernel)",
+                   "0");
 
    option_parser_register(opp, "-gpgpu_deadlock_detect", OPT_BOOL, &gpu_deadlock_detect, 
                 "Stop the simulation at deadlock (1=on (default), 0=off)", 
@@ -495,6 +665,11 @@ void gpgpu_sim::launch( kernel_info_t *kinfo )
       printf("                 modify the CUDA source to decrease the kernel block size.\n");
       abort();
    }
+   if( !m_ckpt_loaded && m_config.gpgpu_ckpt_load && m_config.gpgpu_ckpt_load[0] ) {
+      load_checkpoint( m_config.gpgpu_ckpt_load );
+      m_ckpt_loaded = true;
+   }
+   if( m_hist ) m_hist->kernel_launch();
    unsigned n=0;
    for(n=0; n < m_running_kernels.size(); n++ ) {
        if( (NULL==m_running_kernels[n]) || m_running_kernels[n]->done() ) {
@@ -567,6 +742,214 @@ void gpgpu_sim::set_kernel_done( kernel_info_t *kernel )
         }
     }
     assert( k != m_running_kernels.end() ); 
+    // Pisacha: the HIST epoch only moves once no kernel is left running, so
+    //          concurrent kernels keep their READY entries
+    bool idle = true;
+    for( k=m_running_kernels.begin(); k!=m_running_kernels.end(); k++ ) {
+        if( *k != NULL ) 
+            idle = false;
+    }
+    if( m_hist && idle ) m_hist->kernel_finish();
+    // the checkpoint itself waits for update_stats(), after the L1 flush and
+    // once no request is left in flight
+    if( m_config.gpgpu_ckpt_save && m_config.gpgpu_ckpt_save[0] && 
+        ( m_config.gpgpu_ckpt_kernel == 0 || m_config.gpgpu_ckpt_kernel == uid ) ) 
+        m_ckpt_pending = true;
+}
+
+#define MF_TUP_BEGIN(X) static const char* mf_stage_str[] = {
+#define MF_TUP(X) #X
+#define MF_TUP_END(X) };
+#include "mem_fetch_status.tup"
+#undef MF_TUP_BEGIN
+#undef MF_TUP
+#undef MF_TUP_END
+static const char* mf_hist_stage_str[] = { "HIST_NOC", "HIST_LOOKUP", "HIST_FILTERED", "HIST_FORWARD", "TOTAL" };
+
+static const char *get_mf_stage_str( unsigned stage )
+{
+   return ( stage < NUM_MEM_REQ_STAT )? mf_stage_str[stage] : mf_hist_stage_str[stage - NUM_MEM_REQ_STAT];
+}
+
+static unsigned mf_stage_bucket( unsigned long long lat )
+{
+   unsigned b = 0;
+   while( lat > 0 && b < MF_STAGE_BUCKETS-1 ) {
+      lat >>= 1;
+      b++;
+   }
+   return b;
+}
+
+mf_stage_stats::mf_stage_stats( unsigned n_sm, bool per_sm )
+   : m_n_sm(n_sm), m_per_sm(per_sm),
+     m_hist( (NUM_MF_STAGE+1)*NUM_MEM_ACCESS_TYPE*n_sm*MF_STAGE_BUCKETS, 0 ),
+     m_sum( (NUM_MF_STAGE+1)*NUM_MEM_ACCESS_TYPE*n_sm, 0 )
+{
+   assert( NUM_MF_STAGE <= 64 );
+}
+
+mf_stage_stats::record &mf_stage_stats::lookup( const mem_fetch *mf )
+{
+   tr1_hash_map<const void*,record>::iterator r = m_inflight.find( mf );
+   if( r != m_inflight.end() ) 
+      return r->second;
+   // first sighting: the request has been initialized since its creation
+   record &rec = m_inflight[ mf ];
+   rec.m_stage = MEM_FETCH_INITIALIZED;
+   rec.m_enter = mf->get_timestamp();
+   rec.m_visited = 0;
+   for( unsigned s=0; s < NUM_MF_STAGE; s++ ) 
+      rec.m_time[s] = 0;
+   return rec;
+}
+
+void mf_stage_stats::enter( const mem_fetch *mf, unsigned stage, unsigned long long cycle )
+{
+   assert( stage < NUM_MF_STAGE );
+   record &rec = lookup( mf );
+   if( rec.m_stage == stage ) 
+      return;
+   rec.m_time[rec.m_stage] += cycle - rec.m_enter;
+   rec.m_visited |= 1ULL << rec.m_stage;
+   rec.m_stage = stage;
+   rec.m_enter = cycle;
+}
+
+void mf_stage_stats::done( const mem_fetch *mf, unsigned long long cycle )
+{
+   // requests that never left the core (L1 hits) have no record
+   tr1_hash_map<const void*,record>::iterator r = m_inflight.find( mf );
+   if( r == m_inflight.end() ) 
+      return;
+   unsigned type = mf->get_access_type();
+   unsigned sid  = mf->get_sid();
+   record &rec = r->second;
+   if( sid >= m_n_sm ) {
+      m_inflight.erase( r );
+      return;
+   }
+   rec.m_time[rec.m_stage] += cycle - rec.m_enter;
+   rec.m_visited |= 1ULL << rec.m_stage;
+
+   unsigned long long total = 0;
+   for( unsigned s=0; s < NUM_MF_STAGE; s++ ) {
+      if( !(rec.m_visited & (1ULL << s)) ) 
+         continue;
+      bucket( s, type, sid, mf_stage_bucket(rec.m_time[s]) )++;
+      m_sum[ (s*NUM_MEM_ACCESS_TYPE + type)*m_n_sm + sid ] += rec.m_time[s];
+      total += rec.m_time[s];
+   }
+   bucket( NUM_MF_STAGE, type, sid, mf_stage_bucket(total) )++;
+   m_sum[ (NUM_MF_STAGE*NUM_MEM_ACCESS_TYPE + type)*m_n_sm + sid ] += total;
+   m_inflight.erase( r );
+}
+
+void mf_stage_stats::drop( const void *mf )
+{
+   m_inflight.erase( mf );
+}
+
+void mf_stage_release( const void *mf )
+{
+   if( g_mf_stage_stats ) 
+      g_mf_stage_stats->drop( mf );
+}
+
+void mf_stage_stats::print( FILE *fp ) const
+{
+   fprintf(fp, "mf_stage_inflight = %zu\n", m_inflight.size());
+   for( unsigned type=0; type < NUM_MEM_ACCESS_TYPE; type++ ) {
+      for( unsigned s=0; s <= NUM_MF_STAGE; s++ ) {
+         unsigned long long count = 0, sum = 0;
+         unsigned long long hist[MF_STAGE_BUCKETS] = {0};
+         for( unsigned sid=0; sid < m_n_sm; sid++ ) {
+            for( unsigned b=0; b < MF_STAGE_BUCKETS; b++ ) {
+               hist[b] += bucket( s, type, sid, b );
+               count   += bucket( s, type, sid, b );
+            }
+            sum += m_sum[ (s*NUM_MEM_ACCESS_TYPE + type)*m_n_sm + sid ];
+         }
+         if( count == 0 ) 
+            continue;
+         fprintf(fp, "mf_stage[%s][%s]: n = %llu, avg = %.2f, log2 hist =",
+                 mem_access_type_str((enum mem_access_type)type), get_mf_stage_str(s), count, (double)sum/count);
+         for( unsigned b=0; b < MF_STAGE_BUCKETS; b++ ) 
+            fprintf(fp, " %llu", hist[b]);
+         fprintf(fp, "\n");
+         if( !m_per_sm ) 
+            continue;
+         for( unsigned sid=0; sid < m_n_sm; sid++ ) {
+            unsigned long long sm_count = 0;
+            for( unsigned b=0; b < MF_STAGE_BUCKETS; b++ ) 
+               sm_count += bucket( s, type, sid, b );
+            if( sm_count == 0 ) 
+               continue;
+            fprintf(fp, "    sm %3u: n = %llu, avg = %.2f, log2 hist =", sid, sm_count,
+                    (double)m_sum[ (s*NUM_MEM_ACCESS_TYPE + type)*m_n_sm + sid ]/sm_count);
+            for( unsigned b=0; b < MF_STAGE_BUCKETS; b++ ) 
+               fprintf(fp, " %llu", bucket( s, type, sid, b ));
+            fprintf(fp, "\n");
+         }
+      }
+   }
+}
+
+// Checkpoint layout (version 8): magic, version, number of shaders and a
+// HIST flag, then the L1I and L1 data-side caches of every shader in cluster
+// order, then the HIST table and its page table when HIST is enabled.
+static const char ckpt_magic[8] = { 'G','P','U','C','K','P','T','\0' };
+static const unsigned ckpt_version = 8;
+
+void gpgpu_sim::save_checkpoint( const char *filename ) const
+{
+   FILE *fp = fopen( filename, "wb" );
+   if( fp == NULL ) {
+      printf("GPGPU-Sim: cannot open checkpoint file %s\n", filename);
+      abort();
+   }
+   unsigned n_shader = m_shader_config->n_simt_clusters*m_shader_config->n_simt_cores_per_cluster;
+   unsigned has_hist = (m_hist != NULL);
+   ckpt_write( fp, ckpt_magic );
+   ckpt_write( fp, ckpt_version );
+   ckpt_write( fp, n_shader );
+   ckpt_write( fp, has_hist );
+   for (unsigned i=0;i<m_shader_config->n_simt_clusters;i++) 
+      m_cluster[i]->save_state(fp);
+   if( m_hist ) 
+      m_hist->save_state(fp);
+   fclose(fp);
+   printf("GPGPU-Sim: cache and HIST state checkpointed to %s\n", filename);
+}
+
+void gpgpu_sim::load_checkpoint( const char *filename )
+{
+   FILE *fp = fopen( filename, "rb" );
+   if( fp == NULL ) {
+      printf("GPGPU-Sim: cannot open checkpoint file %s\n", filename);
+      abort();
+   }
+   char magic[8];
+   unsigned version, n_shader, has_hist;
+   ckpt_read( fp, magic );
+   ckpt_read( fp, version );
+   if( memcmp( magic, ckpt_magic, sizeof(magic) ) != 0 || version != ckpt_version ) {
+      printf("GPGPU-Sim: %s is not a version %u checkpoint\n", filename, ckpt_version);
+      abort();
+   }
+   ckpt_read( fp, n_shader );
+   ckpt_read( fp, has_hist );
+   if( n_shader != m_shader_config->n_simt_clusters*m_shader_config->n_simt_cores_per_cluster || 
+       has_hist != (m_hist != NULL) ) {
+      printf("GPGPU-Sim: checkpoint %s was taken with a different shader or HIST configuration\n", filename);
+      abort();
+   }
+   for (unsigned i=0;i<m_shader_config->n_simt_clusters;i++) 
+      m_cluster[i]->load_state(fp);
+   if( m_hist ) 
+      m_hist->load_state(fp);
+   fclose(fp);
+   printf("GPGPU-Sim: cache and HIST state restored from %s\n", filename);
 }
 
 void set_ptx_warp_size(const struct core_config * warp_size);
@@ -593,15 +976,38 @@ gpgpu_sim::gpgpu_sim( const gpgpu_sim_config &config )
     gpu_tot_sim_insn = 0;
     gpu_tot_issued_cta = 0;
     gpu_deadlock = false;
+    m_ckpt_loaded = false;
+    m_ckpt_pending = false;
+
+    // Pisacha: HIST table allocation. Without sets or ways m_hist stays NULL
+    //          and the caches are built without a gpu_root, so a baseline
+    //          config never enters a HIST hook.
+    m_hist = NULL;
+    if( m_config.gpu_hist_nset > 0 && m_config.gpu_hist_assoc > 0 )
+        m_hist = new HIST_table( m_config.gpu_hist_nset,
+                                 m_config.gpu_hist_assoc,
+                                 m_config.gpu_hist_range,
+                                 m_config.gpu_hist_delay,
+                                 m_config.gpu_hist_age,
+                                 m_shader_config->n_simt_clusters * m_shader_config->n_simt_cores_per_cluster,
+                                 m_shader_config->m_L1D_config, this);
+    // Pisacha: one table tracks every L1 that joins HIST, keyed by the L1D line
+    if( m_hist ) {
+        unsigned line_sz = m_shader_config->m_L1D_config.get_line_sz();
+        if( ( m_config.gpu_hist_const && m_shader_config->m_L1C_config.get_line_sz() != line_sz ) ||
+            ( m_config.gpu_hist_tex && m_shader_config->m_L1T_config.get_line_sz() != line_sz ) ) {
+            printf("GPGPU-Sim: -gpgpu_hist_const/-gpgpu_hist_tex need L1C/L1T lines of the L1D line size (%u B)\n", line_sz);
+            abort();
+        }
+    }
+    if( m_config.gpgpu_mf_stage_stats ) 
+        g_mf_stage_stats = new mf_stage_stats( m_shader_config->n_simt_clusters * m_shader_config->n_simt_cores_per_cluster,
+                                               m_config.gpgpu_mf_stage_stats > 1 );
+
+    // compressed caches size their lines from the functional memory contents
+    if( m_shader_config->m_L1D_config.compressed() || m_memory_config->m_L2_config.compressed() )
+        g_cache_data = get_global_memory();
 
-    // Pisacha: HIST table allocation
-    m_hist = new HIST_table( m_config.gpu_hist_nset,
-                             m_config.gpu_hist_assoc,
-                             m_config.gpu_hist_range,
-                             m_config.gpu_hist_delay,
-                             m_config.gpu_hist_age,
-                             m_shader_config->n_simt_clusters * m_shader_config->n_simt_cores_per_cluster,
-                             m_shader_config->m_L1D_config, this);
     set_distribute = new unsigned long long[m_config.gpu_hist_nset];
     for( unsigned i=0; i<m_config.gpu_hist_nset; i++ )
         set_distribute[i] = 0;
@@ -720,6 +1126,7 @@ bool gpgpu_sim::active()
 void gpgpu_sim::init()
 {
     // run a CUDA grid on the GPU microarchitecture simulator
+    save_pending_checkpoint();
     gpu_sim_cycle = 0;
     gpu_sim_insn = 0;
     last_gpu_sim_insn = 0;
@@ -759,6 +1166,17 @@ void gpgpu_sim::update_stats() {
     m_memory_stats->memlatstat_lat_pw();
     gpu_tot_sim_cycle += gpu_sim_cycle;
     gpu_tot_sim_insn += gpu_sim_insn;
+    save_pending_checkpoint();
+}
+
+// The checkpoint of a finished kernel is taken in update_stats(). If the next
+// launch comes first, init() takes it instead, so it is never dropped.
+void gpgpu_sim::save_pending_checkpoint()
+{
+    if( m_ckpt_pending ) {
+        save_checkpoint( m_config.gpgpu_ckpt_save );
+        m_ckpt_pending = false;
+    }
 }
 
 void gpgpu_sim::print_stats()
@@ -808,6 +1226,8 @@ void gpgpu_sim::deadlock_check()
          printf("GPGPU-Sim uArch DEADLOCK:  iterconnect contains traffic\n");
          icnt_display_state( stdout );
       }
+      if( m_ckpt_pending ) 
+         printf("GPGPU-Sim uArch DEADLOCK:  checkpoint %s not written\n", m_config.gpgpu_ckpt_save );
       printf("\nRe-run the simulator in gdb and use debug routines in .gdbinit to debug this\n");
       fflush(stdout);
       abort();
@@ -943,6 +1363,77 @@ void gpgpu_sim::gpu_print_stat()
    printf("hist_ctr_FILL = %lld\n", hist_ctr_FILL);
    printf("hist_ctr_GPROBE_S = %lld\n", hist_ctr_GPROBE_S);
    printf("hist_ctr_GPROBE_F = %lld\n", hist_ctr_GPROBE_F);
+   printf("hist_ctr_BYPASS_LOCAL = %lld\n", hist_ctr_BYPASS_LOCAL);
+   printf("hist_ctr_BYPASS_PRIVATE = %lld\n", hist_ctr_BYPASS_PRIVATE);
+   printf("hist_ctr_PAGE_PRIVATE = %lld\n", hist_ctr_PAGE_PRIVATE);
+   printf("hist_ctr_PAGE_SHARED_RO = %lld\n", hist_ctr_PAGE_SHARED_RO);
+   printf("hist_ctr_PAGE_SHARED_RW = %lld\n", hist_ctr_PAGE_SHARED_RW);
+   if( m_hist ) m_hist->print_page_stats();
+   printf("hist_ctr_INV_WRITE = %lld\n", hist_ctr_INV_WRITE);
+   printf("hist_ctr_INV_MSG = %lld\n", hist_ctr_INV_MSG);
+   printf("hist_ctr_INV_HOPS = %lld\n", hist_ctr_INV_HOPS);
+   printf("hist_ctr_INV_HIT = %lld\n", hist_ctr_INV_HIT);
+   printf("hist_ctr_INV_WAIT = %lld\n", hist_ctr_INV_WAIT);
+   printf("hist_ctr_ATOM_NEAR = %lld\n", hist_ctr_ATOM_NEAR);
+   printf("hist_ctr_ATOM_L2 = %lld\n", hist_ctr_ATOM_L2);
+   printf("hist_ctr_ATOM_LAT = %lld\n", hist_ctr_ATOM_LAT);
+   printf("hist_ctr_ATOM_QUEUE = %lld\n", hist_ctr_ATOM_QUEUE);
+   if( m_hist ) m_hist->print_stale_stats();
+   if( m_hist ) m_hist->print_retry_stats();
+   printf("hist_ctr_TABLE_ACCESS = %lld\n", hist_ctr_TABLE_ACCESS);
+   printf("hist_ctr_MERGE = %lld\n", hist_ctr_MERGE);
+   printf("hist_ctr_MERGE_TXN = %lld\n", hist_ctr_MERGE_TXN);
+   printf("hist_ctr_EJECT = %lld\n", hist_ctr_EJECT);
+   printf("hist_ctr_EJECT_STALL = %lld\n", hist_ctr_EJECT_STALL);
+   printf("hist_ctr_EJECT_BP = %lld\n", hist_ctr_EJECT_BP);
+   printf("hist_ctr_CONST_TOT = %lld\n", hist_ctr_CONST_TOT);
+   printf("hist_ctr_CONST_FWD = %lld\n", hist_ctr_CONST_FWD);
+   printf("hist_ctr_TEX_TOT = %lld\n", hist_ctr_TEX_TOT);
+   printf("hist_ctr_TEX_FWD = %lld\n", hist_ctr_TEX_FWD);
+   printf("hist_ctr_EPOCH = %lld\n", hist_ctr_EPOCH);
+   printf("hist_ctr_EPOCH_DROP = %lld\n", hist_ctr_EPOCH_DROP);
+   if( m_hist ) {
+      // GPUWattch has no HIST component: HIST traffic stays out of its
+      // interconnect counters and table energy comes from
+      // -gpgpu_hist_access_energy
+      m_hist->print_noc_stats();
+      for( unsigned i=0; i<m_shader_config->num_shader(); i++ ) {
+         if( m_shader_stats->n_simt_to_hist[i] || m_shader_stats->n_hist_to_simt[i] )
+            printf("hist_noc_sm[%u]: flits out = %ld, in = %ld\n", i,
+                   m_shader_stats->n_simt_to_hist[i], m_shader_stats->n_hist_to_simt[i]);
+      }
+   }
+   mem_fetch_pool::instance().print_stats( stdout );
+   if( m_shader_config->gpgpu_l1d_bypass_pred ) {
+      unsigned long long trained = l1d_bp_ctr_DEAD_OK + l1d_bp_ctr_DEAD_WRONG + l1d_bp_ctr_LIVE_OK + l1d_bp_ctr_LIVE_WRONG;
+      printf("l1d_bp_ctr_BYPASS = %lld\n", l1d_bp_ctr_BYPASS);
+      printf("l1d_bp_ctr_SAMPLE = %lld\n", l1d_bp_ctr_SAMPLE);
+      printf("l1d_bp_ctr_DEAD_OK = %lld\n", l1d_bp_ctr_DEAD_OK);
+      printf("l1d_bp_ctr_DEAD_WRONG = %lld\n", l1d_bp_ctr_DEAD_WRONG);
+      printf("l1d_bp_ctr_LIVE_OK = %lld\n", l1d_bp_ctr_LIVE_OK);
+      printf("l1d_bp_ctr_LIVE_WRONG = %lld\n", l1d_bp_ctr_LIVE_WRONG);
+      printf("l1d_bp_accuracy = %.4f\n", trained? (float)(l1d_bp_ctr_DEAD_OK + l1d_bp_ctr_LIVE_OK) / trained : 0.0f);
+   }
+   if( m_shader_config->gpgpu_l1d_victim_entries ) {
+      unsigned long long lookups = l1d_vc_ctr_HIT + l1d_vc_ctr_MISS;
+      printf("l1d_vc_ctr_HIT = %lld\n", l1d_vc_ctr_HIT);
+      printf("l1d_vc_ctr_MISS = %lld\n", l1d_vc_ctr_MISS);
+      printf("l1d_vc_ctr_PORT_STALL = %lld\n", l1d_vc_ctr_PORT_STALL);
+      printf("l1d_vc_ctr_SWAP_STALL = %lld\n", l1d_vc_ctr_SWAP_STALL);
+      printf("l1d_vc_ctr_DROP = %lld\n", l1d_vc_ctr_DROP);
+      printf("l1d_vc_hit_rate = %.4f\n", lookups? (float)l1d_vc_ctr_HIT / lookups : 0.0f);
+   }
+   if( strcmp(m_shader_config->gpgpu_l1d_prefetcher, "none") ) {
+      printf("l1d_pf_ctr_ISSUED = %lld\n", l1d_pf_ctr_ISSUED);
+      printf("l1d_pf_ctr_DROP = %lld\n", l1d_pf_ctr_DROP);
+      printf("l1d_pf_ctr_USEFUL = %lld\n", l1d_pf_ctr_USEFUL);
+      printf("l1d_pf_ctr_LATE = %lld\n", l1d_pf_ctr_LATE);
+      printf("l1d_pf_ctr_UNUSED = %lld\n", l1d_pf_ctr_UNUSED);
+      printf("l1d_pf_ctr_POLLUTION = %lld\n", l1d_pf_ctr_POLLUTION);
+      printf("l1d_pf_accuracy = %.4f\n", l1d_pf_ctr_ISSUED? (float)l1d_pf_ctr_USEFUL / l1d_pf_ctr_ISSUED : 0.0f);
+      printf("l1d_pf_timeliness = %.4f\n", l1d_pf_ctr_USEFUL? (float)(l1d_pf_ctr_USEFUL - l1d_pf_ctr_LATE) / l1d_pf_ctr_USEFUL : 0.0f);
+   }
+   if( g_mf_stage_stats ) g_mf_stage_stats->print( stdout );
    for( unsigned i=0; i<m_config.gpu_hist_nset; i++ )
       printf("   set_distribute[%2u] = %lld\n", i, set_distribute[i]);
 
@@ -1010,6 +1501,10 @@ void gpgpu_sim::gpu_print_stat()
           printf("L2_total_cache_breakdown:\n");
           l2_stats.print_stats(stdout, "L2_cache_stats_breakdown");
           total_l2_css.print_port_stats(stdout, "L2_cache");
+          total_l2_css.print_sector_stats(stdout, "L2_cache");
+          total_l2_css.print_set_stats(stdout, "L2_cache");
+          if(m_memory_config->m_L2_config.compressed())
+              total_l2_css.print_compression_stats(stdout, "L2_cache");
        }
    }
 
@@ -1212,8 +1707,10 @@ void gpgpu_sim::cycle()
        // shader core loading (pop from ICNT into core) follows CORE clock
       for (unsigned i=0;i<m_shader_config->n_simt_clusters;i++) 
          m_cluster[i]->icnt_cycle(); 
-      for (unsigned i=0;i<m_shader_config->n_simt_clusters*m_shader_config->n_simt_cores_per_cluster;i++)
-         m_hist->recv_cycle( i );
+      if( m_hist ) {
+         for (unsigned i=0;i<m_shader_config->n_simt_clusters*m_shader_config->n_simt_cores_per_cluster;i++)
+            m_hist->recv_cycle( i );
+      }
    }
     if (clock_mask & ICNT) {
         // pop from memory controller to interconnect
@@ -1225,6 +1722,7 @@ void gpgpu_sim::cycle()
                     if (!mf->get_is_write()) 
                        mf->set_return_timestamp(gpu_sim_cycle+gpu_tot_sim_cycle);
                     mf->set_status(IN_ICNT_TO_SHADER,gpu_sim_cycle+gpu_tot_sim_cycle);
+                    mf_stage(mf,IN_ICNT_TO_SHADER,gpu_sim_cycle+gpu_tot_sim_cycle);
                     ::icnt_push( m_shader_config->mem2device(i), mf->get_tpc(), mf, response_size );
                     m_memory_sub_partition[i]->pop();
                 } else {
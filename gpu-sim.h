@@ -288,8 +288,123 @@ extern unsigned long long hist_ctr_GPROBE_S;
 extern unsigned long long hist_ctr_GPROBE_F;
 extern unsigned long long hist_ctr_FILL;
 extern unsigned long long hist_ctr_FILL_TIME;
+extern unsigned long long hist_ctr_BYPASS_LOCAL;
+extern unsigned long long hist_ctr_BYPASS_PRIVATE;
+extern unsigned long long hist_ctr_BYPASS_ALLOC;
+extern unsigned long long hist_ctr_PAGE_PRIVATE;
+extern unsigned long long hist_ctr_PAGE_SHARED_RO;
+extern unsigned long long hist_ctr_PAGE_SHARED_RW;
+extern unsigned long long hist_ctr_INV_WRITE;
+extern unsigned long long hist_ctr_INV_MSG;
+extern unsigned long long hist_ctr_INV_HOPS;
+extern unsigned long long hist_ctr_INV_HIT;
+extern unsigned long long hist_ctr_INV_WAIT;
+extern unsigned long long hist_ctr_ATOM_NEAR;
+extern unsigned long long hist_ctr_ATOM_L2;
+extern unsigned long long hist_ctr_ATOM_LAT;
+extern unsigned long long hist_ctr_ATOM_QUEUE;
+extern unsigned long long hist_ctr_EVICT_MSG;
+extern unsigned long long hist_ctr_EVICT_BATCH;
+extern unsigned long long hist_ctr_STALE;
+extern unsigned long long hist_ctr_STALE_LAT;
+extern unsigned long long hist_ctr_EVICT_STALE;
+extern unsigned long long hist_ctr_RETRY;
+extern unsigned long long hist_ctr_RETRY_OK;
+extern unsigned long long hist_ctr_RETRY_FAIL;
+extern unsigned long long hist_ctr_RETRY_LAT;
+extern unsigned long long hist_ctr_TABLE_ACCESS;
+extern unsigned long long hist_ctr_MERGE;
+extern unsigned long long hist_ctr_MERGE_TXN;
+extern unsigned long long hist_ctr_EJECT;
+extern unsigned long long hist_ctr_EJECT_STALL;
+extern unsigned long long hist_ctr_EJECT_BP;
+extern unsigned long long hist_ctr_CONST_TOT;
+extern unsigned long long hist_ctr_CONST_FWD;
+extern unsigned long long hist_ctr_TEX_TOT;
+extern unsigned long long hist_ctr_TEX_FWD;
+extern unsigned long long hist_ctr_EPOCH;
+extern unsigned long long hist_ctr_EPOCH_DROP;
+
+// L1D bypass predictor
+extern unsigned long long l1d_bp_ctr_BYPASS;
+extern unsigned long long l1d_bp_ctr_SAMPLE;
+extern unsigned long long l1d_bp_ctr_DEAD_OK;
+extern unsigned long long l1d_bp_ctr_DEAD_WRONG;
+extern unsigned long long l1d_bp_ctr_LIVE_OK;
+extern unsigned long long l1d_bp_ctr_LIVE_WRONG;
+
+// L1D victim cache
+extern unsigned long long l1d_vc_ctr_HIT;
+extern unsigned long long l1d_vc_ctr_MISS;
+extern unsigned long long l1d_vc_ctr_PORT_STALL;
+extern unsigned long long l1d_vc_ctr_SWAP_STALL;
+extern unsigned long long l1d_vc_ctr_DROP;
+
+// L1D prefetcher
+extern unsigned long long l1d_pf_ctr_ISSUED;
+extern unsigned long long l1d_pf_ctr_DROP;
+extern unsigned long long l1d_pf_ctr_USEFUL;
+extern unsigned long long l1d_pf_ctr_LATE;
+extern unsigned long long l1d_pf_ctr_UNUSED;
+extern unsigned long long l1d_pf_ctr_POLLUTION;
 extern unsigned long long *set_distribute;
 
+// Per-stage mem_fetch latency. A request's time is charged to the stage it
+// was last seen entering (a mem_fetch_status or a HIST stage) and goes into
+// log2 histograms per access type and SM once the request completes. Status
+// changes made inside the memory partition are not seen here, so that part
+// of the round trip is charged to IN_ICNT_TO_MEM. A miss merged into an
+// existing MSHR is charged to the L1 miss queue stage until its data returns.
+// Records are keyed by the mem_fetch address and released when the mem_fetch
+// is freed, so writebacks and requests deleted in the partition do not pile up.
+#define MF_STAGE_BUCKETS 24
+
+class mf_stage_stats {
+public:
+    mf_stage_stats( unsigned n_sm, bool per_sm );
+    void enter( const mem_fetch *mf, unsigned stage, unsigned long long cycle );
+    void done( const mem_fetch *mf, unsigned long long cycle );
+    void drop( const void *mf );
+    void print( FILE *fp ) const;
+
+private:
+    struct record {
+        unsigned m_stage;
+        unsigned long long m_enter;
+        unsigned long long m_visited;   // bit per stage
+        unsigned m_time[NUM_MF_STAGE];
+    };
+    record &lookup( const mem_fetch *mf );
+    unsigned long long &bucket( unsigned stage, unsigned type, unsigned sid, unsigned b ) {
+        return m_hist[ ((stage*NUM_MEM_ACCESS_TYPE + type)*m_n_sm + sid)*MF_STAGE_BUCKETS + b ];
+    }
+    unsigned long long bucket( unsigned stage, unsigned type, unsigned sid, unsigned b ) const {
+        return m_hist[ ((stage*NUM_MEM_ACCESS_TYPE + type)*m_n_sm + sid)*MF_STAGE_BUCKETS + b ];
+    }
+
+    unsigned m_n_sm;
+    bool m_per_sm;
+    tr1_hash_map<const void*,record> m_inflight;
+    // [stage (NUM_MF_STAGE = total latency)][access type][sm][log2 bucket]
+    std::vector<unsigned long long> m_hist;
+    std::vector<unsigned long long> m_sum;   // [stage][access type][sm]
+};
+extern mf_stage_stats *g_mf_stage_stats;
+
+// Functional global memory, read by compressed caches. NULL if none is.
+extern const class memory_space *g_cache_data;
+
+inline void mf_stage( const mem_fetch *mf, unsigned stage, unsigned long long cycle ) 
+{
+    if( g_mf_stage_stats ) 
+        g_mf_stage_stats->enter( mf, stage, cycle );
+}
+inline void mf_stage_done( const mem_fetch *mf, unsigned long long cycle ) 
+{
+    if( g_mf_stage_stats ) 
+        g_mf_stage_stats->done( mf, cycle );
+}
+
 class gpgpu_sim_config : public power_config, public gpgpu_functional_sim_config {
 public:
     gpgpu_sim_config() { m_valid = false; }
@@ -334,6 +449,21 @@ public:
     unsigned gpu_hist_range;
     unsigned gpu_hist_delay;
     unsigned gpu_hist_age;
+    unsigned gpu_hist_page_sz;
+    unsigned gpu_hist_atomic;
+    unsigned gpu_hist_atomic_lat;
+    unsigned gpu_hist_evict_notify;
+    unsigned gpu_hist_evict_batch;
+    unsigned gpu_hist_retry_size;
+    unsigned gpu_hist_retry_wait;
+    unsigned gpu_hist_coalesce;
+    unsigned gpu_hist_eject_size;
+    unsigned gpu_hist_eject_width;
+    double gpu_hist_access_energy;
+    unsigned gpu_hist_const;
+    unsigned gpu_hist_tex;
+    unsigned gpu_hist_boundary;
+    unsigned gpu_hist_boundary_age;
 
 private:
     void init_clock_domains(void ); 
@@ -359,6 +489,10 @@ private:
     char *gpgpu_runtime_stat;
     bool  gpgpu_flush_l1_cache;
     bool  gpgpu_flush_l2_cache;
+    char *gpgpu_ckpt_save;
+    char *gpgpu_ckpt_load;
+    unsigned gpgpu_ckpt_kernel;
+    unsigned gpgpu_mf_stage_stats;
     bool  gpu_deadlock_detect;
     int   gpgpu_frfcfs_dram_sched_queue_size; 
     int   gpgpu_cflog_interval;
@@ -393,6 +527,11 @@ public:
    unsigned finished_kernel();
    void set_kernel_done( kernel_info_t *kernel );
 
+   // cache and HIST state checkpoint, taken and restored at kernel boundaries
+   void save_checkpoint( const char *filename ) const;
+   void save_pending_checkpoint();
+   void load_checkpoint( const char *filename );
+
    void init();
    void cycle();
    bool active(); 
@@ -441,9 +580,23 @@ public:
 
 /// Pisacha: Begin HIST function section
     HIST_table *m_hist;
+    bool hist_enabled() const { return m_hist != NULL; }
     
     void fill_respond_queue( int sm_id, mem_fetch* mf_respond ){
-        m_cluster[sm_id/m_shader_config->n_simt_cores_per_cluster]->push_response_fifo( mf_respond );
+        m_cluster[sm_id/m_shader_config->n_simt_cores_per_cluster]->push_hist_response( mf_respond );
+    }
+    void hist_icnt_power( int src_sm, int dst_sm, unsigned flits ){
+        m_shader_stats->n_simt_to_hist[src_sm] += flits;
+        m_shader_stats->n_hist_to_simt[dst_sm] += flits;
+    }
+    bool hist_response_full( int sm_id ) const {
+        return m_cluster[sm_id/m_shader_config->n_simt_cores_per_cluster]->hist_response_full();
+    }
+    bool hist_invalidate( int sm_id, new_addr_type addr ){
+        return m_cluster[sm_id/m_shader_config->n_simt_cores_per_cluster]->hist_invalidate( sm_id, addr );
+    }
+    bool hist_holds( int sm_id, new_addr_type addr, int except_type = -1 ) const {
+        return m_cluster[sm_id/m_shader_config->n_simt_cores_per_cluster]->hist_holds( sm_id, addr, except_type );
     }
 /// Pisacha: End of HIST function section
 
@@ -485,6 +638,9 @@ private:
    // debug
    bool gpu_deadlock;
 
+   bool m_ckpt_loaded;
+   bool m_ckpt_pending;
+
    //// configuration parameters ////
    const gpgpu_sim_config &m_config;
   
@@ -47,6 +47,79 @@ enum mf_type {
 #undef MF_TUP
 #undef MF_TUP_END
 
+// Latency stages beyond mem_fetch_status, for the time a request spends in HIST
+enum mf_hist_stage {
+   MF_STAGE_HIST_NOC = NUM_MEM_REQ_STAT, // out_mf, probe travelling to the home
+   MF_STAGE_HIST_LOOKUP,                 // queued at the home, retry buffer included
+   MF_STAGE_HIST_FILTERED,               // parked on a HIST_WAIT entry
+   MF_STAGE_HIST_FORWARD,                // forwarded data travelling to the requester
+   NUM_MF_STAGE
+};
+
+// In-flight instruction record shared by all mem_fetch objects generated by
+// one warp instruction, instead of each request carrying its own copy of
+// the warp_inst_t. The record is freed when its last reference goes away;
+// note that shader_core_mem_fetch_allocator holds a reference to the last
+// instruction it saw, so one record per SM outlives its requests.
+class inflight_inst_ref {
+public:
+   inflight_inst_ref() : m_rec(NULL) {}
+   explicit inflight_inst_ref( const warp_inst_t &inst ) : space(inst.space), m_rec(new record(inst)) {}
+   inflight_inst_ref( const inflight_inst_ref &other ) : space(other.space), m_rec(other.m_rec) { if( m_rec ) m_rec->m_refs++; }
+   ~inflight_inst_ref() { reset(); }
+
+   inflight_inst_ref &operator=( const inflight_inst_ref &other )
+   {
+      if( other.m_rec ) 
+         other.m_rec->m_refs++;
+      reset();
+      m_rec = other.m_rec;
+      space = other.space;
+      return *this;
+   }
+   // private copy, for requests built from a bare warp_inst_t
+   inflight_inst_ref &operator=( const warp_inst_t &inst )
+   {
+      reset();
+      m_rec = new record(inst);
+      space = inst.space;
+      return *this;
+   }
+   void reset()
+   {
+      if( m_rec && --m_rec->m_refs == 0 ) 
+         delete m_rec;
+      m_rec = NULL;
+      space = memory_space_t();
+   }
+
+   bool empty() const { return m_rec == NULL || m_rec->m_inst.empty(); }
+   const warp_inst_t &get() const 
+   {
+      static const warp_inst_t empty_inst;
+      return m_rec? m_rec->m_inst : empty_inst;
+   }
+   unsigned refs() const { return m_rec? m_rec->m_refs : 0; }
+
+   // warp_inst_t interface used on requests
+   unsigned warp_id() const { return get().warp_id(); }
+   bool isatomic() const { return get().isatomic(); }
+   void do_atomic( const active_mask_t &access_mask ) { assert(m_rec); m_rec->m_inst.do_atomic(access_mask); }
+   void print( FILE *fp ) const { get().print(fp); }
+
+   // copy of the instruction's memory space, so mem_fetch::istexture() and
+   // isconst() can keep reading m_inst.space
+   memory_space_t space;
+
+private:
+   struct record {
+      record( const warp_inst_t &inst ) : m_inst(inst), m_refs(1) {}
+      warp_inst_t m_inst;
+      unsigned m_refs;
+   };
+   record *m_rec;
+};
+
 class mem_fetch {
 public:
     mem_fetch( const mem_access_t &access, 
@@ -104,14 +177,20 @@ public:
    const active_mask_t& get_access_warp_mask() const { return m_access.get_warp_mask(); }
    mem_access_byte_mask_t get_access_byte_mask() const { return m_access.get_byte_mask(); }
 
-   address_type get_pc() const { return m_inst.empty()?-1:m_inst.pc; }
-   const warp_inst_t &get_inst() { return m_inst; }
+   address_type get_pc() const { return m_inst.empty()?-1:m_inst.get().pc; }
+   const warp_inst_t &get_inst() { return m_inst.get(); }
+   const inflight_inst_ref &get_inst_ref() const { return m_inst; }
+   void set_inst( const inflight_inst_ref &inst ) { m_inst = inst; }
    enum mem_fetch_status get_status() const { return m_status; }
 
    const memory_config *get_mem_config(){return m_mem_config;}
 
    unsigned get_num_flits(bool simt_to_mem);
 
+   // all mem_fetch objects are carved out of a slab pool, see mem_fetch_pool
+   static void *operator new( size_t size );
+   static void operator delete( void *p );
+
 /// HIST
    void set_wait(unsigned cycle){
        m_wait = cycle;
@@ -165,8 +244,8 @@ private:
    unsigned m_timestamp2; // set to gpu_sim_cycle+gpu_tot_sim_cycle when pushed onto icnt to shader; only used for reads
    unsigned m_icnt_receive_time; // set to gpu_sim_cycle + interconnect_latency when fixed icnt latency mode is enabled
 
-   // requesting instruction (put last so mem_fetch prints nicer in gdb)
-   warp_inst_t m_inst;
+   // requesting instruction, shared with the other requests it generated
+   inflight_inst_ref m_inst;
 
    static unsigned sm_next_mf_request_uid;
 
@@ -174,4 +253,92 @@ private:
    unsigned icnt_flit_size;
 };
 
+// Slab allocator for mem_fetch. Every simulation thread owns one pool; objects
+// are taken from slabs of MF_SLAB_SLOTS entries and recycled through an
+// intrusive free list, so queue-heavy phases do not go through the heap.
+// Slabs are never returned. Live/peak counts give leak accounting at exit.
+#define MF_SLAB_SLOTS 4096
+
+class mem_fetch_pool {
+public:
+   mem_fetch_pool() : m_free(NULL), m_slot_size(0), m_num_slabs(0), m_num_alloc(0), m_num_free(0), m_peak(0) {}
+
+   static mem_fetch_pool &instance()
+   {
+      static __thread mem_fetch_pool *pool = NULL;
+      if( pool == NULL ) 
+         pool = new mem_fetch_pool();
+      return *pool;
+   }
+
+   void *alloc( size_t size )
+   {
+      if( m_slot_size == 0 ) 
+         m_slot_size = ( size + sizeof(void*) - 1 ) / sizeof(void*) * sizeof(void*);
+      assert( size <= m_slot_size );
+      if( m_free == NULL ) 
+         grow();
+      void *p = m_free;
+      m_free = *(void**)p;
+      m_num_alloc++;
+      if( live() > m_peak ) 
+         m_peak = live();
+      return p;
+   }
+   void release( void *p )
+   {
+      *(void**)p = m_free;
+      m_free = p;
+      m_num_free++;
+   }
+
+   long long live() const { return (long long)m_num_alloc - (long long)m_num_free; }
+   void print_stats( FILE *fp ) const
+   {
+      fprintf(fp, "mem_fetch_alloc = %llu\n", m_num_alloc);
+      fprintf(fp, "mem_fetch_free = %llu\n", m_num_free);
+      fprintf(fp, "mem_fetch_live = %lld\n", live());
+      fprintf(fp, "mem_fetch_peak = %lld\n", m_peak);
+      fprintf(fp, "mem_fetch_slabs = %u (%zu bytes)\n", m_num_slabs, (size_t)m_num_slabs * MF_SLAB_SLOTS * m_slot_size);
+   }
+
+private:
+   void grow()
+   {
+      char *slab = (char*) malloc( MF_SLAB_SLOTS * m_slot_size );
+      assert( slab != NULL );
+      for( unsigned i=0; i < MF_SLAB_SLOTS; i++ ) 
+         release_slot( slab + i * m_slot_size );
+      m_num_slabs++;
+   }
+   void release_slot( void *p )
+   {
+      *(void**)p = m_free;
+      m_free = p;
+   }
+
+   void *m_free;
+   size_t m_slot_size;
+   unsigned m_num_slabs;
+   unsigned long long m_num_alloc;
+   unsigned long long m_num_free;
+   long long m_peak;
+};
+
+inline void *mem_fetch::operator new( size_t size )
+{
+   return mem_fetch_pool::instance().alloc( size );
+}
+
+// drops the latency record of a freed request (gpu-sim.cc)
+void mf_stage_release( const void *mf );
+
+inline void mem_fetch::operator delete( void *p )
+{
+   if( p != NULL ) {
+      mf_stage_release( p );
+      mem_fetch_pool::instance().release( p );
+   }
+}
+
 #endif
@@ -665,6 +665,7 @@ void shader_core_ctx::fetch()
     if( m_L1I->access_ready() ) {
         mem_fetch *mf = m_L1I->next_access();
         m_warp[mf->get_wid()].clear_imiss_pending();
+        mf_stage_done(mf,gpu_sim_cycle+gpu_tot_sim_cycle);
         delete mf;
     }
 }
@@ -1393,6 +1394,15 @@ bool ldst_unit::memory_cycle( warp_inst_t &inst, mem_stage_stall_type &stall_rea
        if (m_core->get_config()->gmem_skip_L1D) 
            bypassL1D = true; 
    }
+   // loads whose PC is predicted to see no reuse in L1D. The predictor is
+   // asked once per instruction, not again when a stalled access retries.
+   if ( !bypassL1D && m_bypass_pred && inst.is_load() && !inst.isatomic() ) {
+       if ( m_bypass_uid != inst.get_uid() ) {
+           m_bypass_uid = inst.get_uid();
+           m_bypass_inst = m_bypass_pred->bypass( inst.pc );
+       }
+       bypassL1D = m_bypass_inst;
+   }
 
    if( bypassL1D ) {
        // bypass L1 cache
@@ -1402,7 +1412,19 @@ bool ldst_unit::memory_cycle( warp_inst_t &inst, mem_stage_stall_type &stall_rea
            stall_cond = ICNT_RC_FAIL;
        } else {
            mem_fetch *mf = m_mf_allocator->alloc(inst,access);
-           m_icnt->push(mf);
+           unsigned time = gpu_sim_cycle + gpu_tot_sim_cycle;
+           // Pisacha: near-data atomic at the HIST home, otherwise to L2. A
+           //          store or atomic going to L2 around the L1D invalidates
+           //          HIST sharers as a store through the L1D does.
+           if( !( inst.isatomic() && m_gpu->hist_enabled() && m_gpu->m_hist->atomic_enabled()
+                  && m_gpu->m_hist->atomic( m_sid, mf, time ) ) ) {
+               if( m_gpu->hist_enabled() && ( inst.is_store() || inst.isatomic() ) ) {
+                   if( m_gpu->m_hist->page_filter_enabled() )
+                       m_gpu->m_hist->page_access( m_sid, mf->get_addr(), true );
+                   m_gpu->m_hist->write( m_sid, mf->get_addr(), time );
+               }
+               m_icnt->push(mf);
+           }
            inst.accessq_pop_back();
            //inst.clear_active( access.get_warp_mask() );
            if( inst.is_load() ) { 
@@ -1418,6 +1440,8 @@ bool ldst_unit::memory_cycle( warp_inst_t &inst, mem_stage_stall_type &stall_rea
    }
    if( !inst.accessq_empty() ) 
        stall_cond = COAL_STALL;
+   else if( m_bypass_uid == inst.get_uid() ) 
+       m_bypass_uid = (unsigned)-1;    // all its accesses are out, forget the decision
    if (stall_cond != NO_RC_FAIL) {
       stall_reason = stall_cond;
       bool iswrite = inst.is_store();
@@ -1430,6 +1454,15 @@ bool ldst_unit::memory_cycle( warp_inst_t &inst, mem_stage_stall_type &stall_rea
 }
 
 
+// Pisacha: Does any L1 of this SM hold addr? except_type is the cache type
+//          id of an L1 that is about to drop the line, it is not asked.
+bool ldst_unit::hist_holds( new_addr_type addr, int except_type ) const
+{
+    return ( except_type != get_shader_normal_cache_id() && m_L1D && m_L1D->holds( addr ) ) 
+        || ( except_type != get_shader_constant_cache_id() && m_L1C->holds( addr ) ) 
+        || ( except_type != get_shader_texture_cache_id() && m_L1T->holds( addr ) );
+}
+
 bool ldst_unit::response_buffer_full() const
 {
     return m_response_fifo.size() >= m_config->ldst_unit_response_queue_size;
@@ -1438,6 +1471,7 @@ bool ldst_unit::response_buffer_full() const
 void ldst_unit::fill( mem_fetch *mf )
 {
     mf->set_status(IN_SHADER_LDST_RESPONSE_FIFO,gpu_sim_cycle+gpu_tot_sim_cycle);
+    mf_stage(mf,IN_SHADER_LDST_RESPONSE_FIFO,gpu_sim_cycle+gpu_tot_sim_cycle);
     m_response_fifo.push_back(mf);
 }
 
@@ -1446,6 +1480,30 @@ void ldst_unit::flush(){
 	m_L1D->flush();
 }
 
+void ldst_unit::save_state( FILE *fp ) const
+{
+    unsigned has_l1d = (m_L1D != NULL);
+    ckpt_write( fp, has_l1d );
+    if( m_L1D ) 
+        m_L1D->save_state(fp);
+    m_L1C->save_state(fp);
+    m_L1T->save_state(fp);
+}
+
+void ldst_unit::load_state( FILE *fp )
+{
+    unsigned has_l1d;
+    ckpt_read( fp, has_l1d );
+    if( has_l1d != (m_L1D != NULL) ) {
+        printf("GPGPU-Sim: checkpoint L1D configuration does not match shader %u\n", m_sid);
+        abort();
+    }
+    if( m_L1D ) 
+        m_L1D->load_state(fp);
+    m_L1C->load_state(fp);
+    m_L1T->load_state(fp);
+}
+
 simd_function_unit::simd_function_unit( const shader_core_config *config )
 { 
     m_config=config;
@@ -1577,9 +1635,17 @@ void ldst_unit::init( mem_fetch_interface *icnt,
     char L1C_name[STRSIZE];
     snprintf(L1T_name, STRSIZE, "L1T_%03d", m_sid);
     snprintf(L1C_name, STRSIZE, "L1C_%03d", m_sid);
-    m_L1T = new tex_cache(L1T_name,m_config->m_L1T_config,m_sid,get_shader_texture_cache_id(),icnt,IN_L1T_MISS_QUEUE,IN_SHADER_L1T_ROB);
-    m_L1C = new read_only_cache(L1C_name,m_config->m_L1C_config,m_sid,get_shader_constant_cache_id(),icnt,IN_L1C_MISS_QUEUE, NULL);
+    // Pisacha: L1T/L1C join HIST only when enabled, gpu_root is NULL otherwise
+    m_L1T = new tex_cache(L1T_name,m_config->m_L1T_config,m_sid,get_shader_texture_cache_id(),icnt,IN_L1T_MISS_QUEUE,IN_SHADER_L1T_ROB,
+                          ( gpu->hist_enabled() && gpu->get_config().gpu_hist_tex ) ? gpu : NULL);
+    m_L1C = new read_only_cache(L1C_name,m_config->m_L1C_config,m_sid,get_shader_constant_cache_id(),icnt,IN_L1C_MISS_QUEUE,
+                                ( gpu->hist_enabled() && gpu->get_config().gpu_hist_const ) ? gpu : NULL);
     m_L1D = NULL;
+    m_bypass_pred = NULL;
+    m_bypass_uid = (unsigned)-1;
+    m_bypass_inst = false;
+    m_victim = NULL;
+    m_prefetcher = NULL;
     m_mem_rc = NO_RC_FAIL;
     m_num_writeback_clients=5; // = shared memory, global/local (uncached), L1D, L1T, L1C
     m_writeback_arb = 0;
@@ -1620,7 +1686,29 @@ ldst_unit::ldst_unit( mem_fetch_interface *icnt,
                               get_shader_normal_cache_id(),
                               m_icnt,
                               m_mf_allocator,
-                              IN_L1D_MISS_QUEUE, gpu );
+                              IN_L1D_MISS_QUEUE, gpu->hist_enabled() ? gpu : NULL );
+        if( m_config->gpgpu_l1d_bypass_pred ) {
+            m_bypass_pred = new l1d_bypass_predictor( m_config->gpgpu_l1d_bypass_pred,
+                                                      m_config->gpgpu_l1d_bypass_pred_threshold,
+                                                      m_config->gpgpu_l1d_bypass_pred_sample );
+            m_L1D->set_bypass_predictor( m_bypass_pred );
+        }
+        if( m_config->gpgpu_l1d_victim_entries ) {
+            m_victim = new l1d_victim_cache( m_config->gpgpu_l1d_victim_entries, m_config->gpgpu_l1d_victim_ports );
+            m_L1D->set_victim_cache( m_victim );
+        }
+        unsigned line_sz = m_config->m_L1D_config.get_line_sz();
+        if( !strcmp(m_config->gpgpu_l1d_prefetcher, "stride") ) {
+            m_prefetcher = new stride_prefetcher( line_sz, m_config->gpgpu_l1d_prefetch_degree,
+                                                  m_config->gpgpu_l1d_prefetch_table );
+        } else if( !strcmp(m_config->gpgpu_l1d_prefetcher, "stream") ) {
+            m_prefetcher = new stream_prefetcher( line_sz, m_config->gpgpu_l1d_prefetch_degree );
+        } else if( strcmp(m_config->gpgpu_l1d_prefetcher, "none") ) {
+            printf("GPGPU-Sim uArch: unknown L1D prefetcher \"%s\"\n", m_config->gpgpu_l1d_prefetcher);
+            abort();
+        }
+        if( m_prefetcher ) 
+            m_L1D->set_prefetcher( m_prefetcher );
     }
 }
 
@@ -1649,6 +1737,14 @@ ldst_unit::ldst_unit( mem_fetch_interface *icnt,
           tpc, gpu );
 }
 
+// the L1D only borrows these
+ldst_unit::~ldst_unit()
+{
+    delete m_bypass_pred;
+    delete m_victim;
+    delete m_prefetcher;
+}
+
 void ldst_unit:: issue( register_set &reg_set )
 {
 	warp_inst_t* inst = *(reg_set.get_ready());
@@ -1677,36 +1773,38 @@ void ldst_unit:: issue( register_set &reg_set )
 void ldst_unit::writeback()
 {
     // process next instruction that is going to writeback
-    if( !m_next_wb.empty() ) {
-        if( m_operand_collector->writeback(m_next_wb) ) {
+    const warp_inst_t &next_wb = m_next_wb_ref.empty()? m_next_wb : m_next_wb_ref.get();
+    if( !next_wb.empty() ) {
+        if( m_operand_collector->writeback(next_wb) ) {
             bool insn_completed = false; 
             for( unsigned r=0; r < 4; r++ ) {
-                if( m_next_wb.out[r] > 0 ) {
-                    if( m_next_wb.space.get_type() != shared_space ) {
-                        assert( m_pending_writes[m_next_wb.warp_id()][m_next_wb.out[r]] > 0 );
-                        unsigned still_pending = --m_pending_writes[m_next_wb.warp_id()][m_next_wb.out[r]];
+                if( next_wb.out[r] > 0 ) {
+                    if( next_wb.space.get_type() != shared_space ) {
+                        assert( m_pending_writes[next_wb.warp_id()][next_wb.out[r]] > 0 );
+                        unsigned still_pending = --m_pending_writes[next_wb.warp_id()][next_wb.out[r]];
                         if( !still_pending ) {
-                            m_pending_writes[m_next_wb.warp_id()].erase(m_next_wb.out[r]);
-                            m_scoreboard->releaseRegister( m_next_wb.warp_id(), m_next_wb.out[r] );
+                            m_pending_writes[next_wb.warp_id()].erase(next_wb.out[r]);
+                            m_scoreboard->releaseRegister( next_wb.warp_id(), next_wb.out[r] );
                             insn_completed = true; 
                         }
                     } else { // shared 
-                        m_scoreboard->releaseRegister( m_next_wb.warp_id(), m_next_wb.out[r] );
+                        m_scoreboard->releaseRegister( next_wb.warp_id(), next_wb.out[r] );
                         insn_completed = true; 
                     }
                 }
             }
             if( insn_completed ) {
-                m_core->warp_inst_complete(m_next_wb);
+                m_core->warp_inst_complete(next_wb);
             }
             m_next_wb.clear();
+            m_next_wb_ref.reset();
             m_last_inst_gpu_sim_cycle = gpu_sim_cycle;
             m_last_inst_gpu_tot_sim_cycle = gpu_tot_sim_cycle;
         }
     }
 
     unsigned serviced_client = -1; 
-    for( unsigned c = 0; m_next_wb.empty() && (c < m_num_writeback_clients); c++ ) {
+    for( unsigned c = 0; m_next_wb.empty() && m_next_wb_ref.empty() && (c < m_num_writeback_clients); c++ ) {
         unsigned next_client = (c+m_writeback_arb)%m_num_writeback_clients;
         switch( next_client ) {
         case 0: // shared memory 
@@ -1724,7 +1822,8 @@ void ldst_unit::writeback()
         case 1: // texture response
             if( m_L1T->access_ready() ) {
                 mem_fetch *mf = m_L1T->next_access();
-                m_next_wb = mf->get_inst();
+                m_next_wb_ref = mf->get_inst_ref();
+                mf_stage_done(mf,gpu_sim_cycle+gpu_tot_sim_cycle);
                 delete mf;
                 serviced_client = next_client; 
             }
@@ -1732,16 +1831,18 @@ void ldst_unit::writeback()
         case 2: // const cache response
             if( m_L1C->access_ready() ) {
                 mem_fetch *mf = m_L1C->next_access();
-                m_next_wb = mf->get_inst();
+                m_next_wb_ref = mf->get_inst_ref();
+                mf_stage_done(mf,gpu_sim_cycle+gpu_tot_sim_cycle);
                 delete mf;
                 serviced_client = next_client; 
             }
             break;
         case 3: // global/local
             if( m_next_global ) {
-                m_next_wb = m_next_global->get_inst();
+                m_next_wb_ref = m_next_global->get_inst_ref();
                 if( m_next_global->isatomic() ) 
                     m_core->decrement_atomic_count(m_next_global->get_wid(),m_next_global->get_access_warp_mask().count());
+                mf_stage_done(m_next_global,gpu_sim_cycle+gpu_tot_sim_cycle);
                 delete m_next_global;
                 m_next_global = NULL;
                 serviced_client = next_client; 
@@ -1750,7 +1851,8 @@ void ldst_unit::writeback()
         case 4: 
             if( m_L1D && m_L1D->access_ready() ) {
                 mem_fetch *mf = m_L1D->next_access();
-                m_next_wb = mf->get_inst();
+                m_next_wb_ref = mf->get_inst_ref();
+                mf_stage_done(mf,gpu_sim_cycle+gpu_tot_sim_cycle);
                 delete mf;
                 serviced_client = next_client; 
             }
@@ -1811,6 +1913,7 @@ void ldst_unit::cycle()
        } else if (mf->isconst())  {
            if (m_L1C->fill_port_free()) {
                mf->set_status(IN_SHADER_FETCHED,gpu_sim_cycle+gpu_tot_sim_cycle);
+               mf_stage(mf,IN_SHADER_FETCHED,gpu_sim_cycle+gpu_tot_sim_cycle);
                m_L1C->fill(mf,gpu_sim_cycle+gpu_tot_sim_cycle);
                m_response_fifo.pop_front(); 
            }
@@ -1818,6 +1921,7 @@ void ldst_unit::cycle()
     	   if( mf->get_type() == WRITE_ACK || ( m_config->gpgpu_perfect_mem && mf->get_is_write() )) {
                m_core->store_ack(mf);
                m_response_fifo.pop_front();
+               mf_stage_done(mf,gpu_sim_cycle+gpu_tot_sim_cycle);
                delete mf;
            } else {
                assert( !mf->get_is_write() ); // L1 cache is write evict, allocate line on load miss only
@@ -1829,9 +1933,13 @@ void ldst_unit::cycle()
                    if (m_core->get_config()->gmem_skip_L1D)
                        bypassL1D = true; 
                }
+               // predicted bypass: L1D has no miss outstanding for this request
+               if ( !bypassL1D && m_bypass_pred && !m_L1D->waiting_for_fill(mf) ) 
+                   bypassL1D = true; 
                if( bypassL1D ) {
                    if ( m_next_global == NULL ) {
                        mf->set_status(IN_SHADER_FETCHED,gpu_sim_cycle+gpu_tot_sim_cycle);
+                       mf_stage(mf,IN_SHADER_FETCHED,gpu_sim_cycle+gpu_tot_sim_cycle);
                        m_response_fifo.pop_front();
                        m_next_global = mf;
                    }
@@ -2047,6 +2155,10 @@ void gpgpu_sim::shader_print_cache_stats( FILE *fout ) const{
         fprintf(fout, "\tL1D_total_cache_pending_hits = %u\n", total_css.pending_hits);
         fprintf(fout, "\tL1D_total_cache_reservation_fails = %u\n", total_css.res_fails);
         total_css.print_port_stats(fout, "\tL1D_cache"); 
+        total_css.print_sector_stats(fout, "\tL1D_cache");
+        total_css.print_set_stats(fout, "\tL1D_cache");
+        if(m_shader_config->m_L1D_config.compressed())
+            total_css.print_compression_stats(fout, "\tL1D_cache");
     }
 
     // L1C
@@ -2266,7 +2378,10 @@ void ldst_unit::print(FILE *fout) const
         fprintf(fout,"\n");
     }
     fprintf(fout,"LD/ST wb    = ");
-    m_next_wb.print(fout);
+    if( !m_next_wb_ref.empty() ) 
+        m_next_wb_ref.print(fout);
+    else
+        m_next_wb.print(fout);
     fprintf(fout, "Last LD/ST writeback @ %llu + %llu (gpu_sim_cycle+gpu_tot_sim_cycle)\n",
                   m_last_inst_gpu_sim_cycle, m_last_inst_gpu_tot_sim_cycle );
     fprintf(fout,"Pending register writes:\n");
@@ -2787,6 +2902,7 @@ bool shader_core_ctx::fetch_unit_response_buffer_full() const
 void shader_core_ctx::accept_fetch_response( mem_fetch *mf )
 {
     mf->set_status(IN_SHADER_FETCHED,gpu_sim_cycle+gpu_tot_sim_cycle);
+    mf_stage(mf,IN_SHADER_FETCHED,gpu_sim_cycle+gpu_tot_sim_cycle);
     m_L1I->fill(mf,gpu_sim_cycle+gpu_tot_sim_cycle);
 }
 
@@ -3171,6 +3287,9 @@ simt_core_cluster::simt_core_cluster( class gpgpu_sim *gpu,
         m_core[i] = new shader_core_ctx(gpu,this,sid,m_cluster_id,config,mem_config,stats);
         m_core_sim_order.push_back(i); 
     }
+    m_hist_eject_size  = gpu->get_config().gpu_hist_eject_size;
+    m_hist_eject_width = gpu->get_config().gpu_hist_eject_width;
+    m_hist_eject_prio  = true;
 }
 
 void simt_core_cluster::core_cycle()
@@ -3257,6 +3376,18 @@ void simt_core_cluster::cache_flush()
         m_core[i]->cache_flush();
 }
 
+void simt_core_cluster::save_state( FILE *fp ) const
+{
+    for( unsigned i=0; i < m_config->n_simt_cores_per_cluster; i++ ) 
+        m_core[i]->save_state(fp);
+}
+
+void simt_core_cluster::load_state( FILE *fp )
+{
+    for( unsigned i=0; i < m_config->n_simt_cores_per_cluster; i++ ) 
+        m_core[i]->load_state(fp);
+}
+
 bool simt_core_cluster::icnt_injection_buffer_full(unsigned size, bool write)
 {
     unsigned request_size = size;
@@ -3295,16 +3426,51 @@ void simt_core_cluster::icnt_inject_request_packet(class mem_fetch *mf)
    m_stats->m_outgoing_traffic_stats->record_traffic(mf, packet_size); 
    unsigned destination = mf->get_sub_partition_id();
    mf->set_status(IN_ICNT_TO_MEM,gpu_sim_cycle+gpu_tot_sim_cycle);
+   mf_stage(mf,IN_ICNT_TO_MEM,gpu_sim_cycle+gpu_tot_sim_cycle);
    if (!mf->get_is_write() && !mf->isatomic())
       ::icnt_push(m_cluster_id, m_config->mem2device(destination), (void*)mf, mf->get_ctrl_size() );
    else 
       ::icnt_push(m_cluster_id, m_config->mem2device(destination), (void*)mf, mf->size());
 }
 
+void simt_core_cluster::push_hist_response( mem_fetch *mf )
+{
+    mf_stage(mf,IN_CLUSTER_TO_SHADER_QUEUE,gpu_sim_cycle+gpu_tot_sim_cycle);
+    if( m_hist_eject_size == 0 ) {
+        // unbounded port: HIST data enters the response fifo directly
+        m_response_fifo.push_back(mf);
+        return;
+    }
+    assert( !hist_response_full() );
+    m_hist_response_fifo.push_back(mf);
+}
+
+// Move up to m_hist_eject_width HIST responses into the shared response fifo,
+// leaving 'reserve' slots for the interconnect when it has priority this cycle
+void simt_core_cluster::hist_eject( unsigned reserve )
+{
+    for( unsigned n=0; n < m_hist_eject_width && !m_hist_response_fifo.empty(); n++ ) {
+        if( m_response_fifo.size() + reserve >= m_config->n_simt_ejection_buffer_size ) {
+            hist_ctr_EJECT_STALL++;
+            break;
+        }
+        m_response_fifo.push_back( m_hist_response_fifo.front() );
+        m_hist_response_fifo.pop_front();
+        hist_ctr_EJECT++;
+    }
+}
+
 void simt_core_cluster::icnt_cycle()
 {
-    for( int i=0; i<m_config->n_simt_cores_per_cluster; i++ ){
-        m_core[i]->hist_cycle();
+    if( m_gpu->hist_enabled() ) {
+        for( int i=0; i<m_config->n_simt_cores_per_cluster; i++ ){
+            m_core[i]->hist_cycle();
+        }
+    }
+    if( m_hist_eject_size > 0 ) {
+        // alternate priority between the HIST port and ICNT replies
+        hist_eject( m_hist_eject_prio? 0 : 1 );
+        m_hist_eject_prio = !m_hist_eject_prio;
     }
     if( !m_response_fifo.empty() ) {
         mem_fetch *mf = m_response_fifo.front();
@@ -3337,6 +3503,7 @@ void simt_core_cluster::icnt_cycle()
         unsigned int packet_size = (mf->get_is_write())? mf->get_ctrl_size() : mf->size(); 
         m_stats->m_incoming_traffic_stats->record_traffic(mf, packet_size); 
         mf->set_status(IN_CLUSTER_TO_SHADER_QUEUE,gpu_sim_cycle+gpu_tot_sim_cycle);
+        mf_stage(mf,IN_CLUSTER_TO_SHADER_QUEUE,gpu_sim_cycle+gpu_tot_sim_cycle);
         //m_memory_stats->memlatstat_read_done(mf,m_shader_config->max_warps_per_shader);
         m_response_fifo.push_back(mf);
         m_stats->n_mem_to_simt[m_cluster_id] += mf->get_num_flits(false);
@@ -959,7 +959,7 @@ class shader_core_config;
 class simd_function_unit {
 public:
     simd_function_unit( const shader_core_config *config );
-    ~simd_function_unit() { delete m_dispatch_reg; }
+    virtual ~simd_function_unit() { delete m_dispatch_reg; }
 
     // modifiers
     virtual void issue( register_set& source_reg ) { source_reg.move_out_to(m_dispatch_reg); occupied.set(m_dispatch_reg->latency);}
@@ -1085,6 +1085,7 @@ public:
                class shader_core_stats *stats, 
                unsigned sid, unsigned tpc, gpgpu_sim *gpu );
                // Pisacha: Add a pointer link to gpgpu_sim
+    virtual ~ldst_unit();
 
     // modifiers
     virtual void issue( register_set &inst );
@@ -1093,6 +1094,8 @@ public:
     void fill( mem_fetch *mf );
     void flush();
     void writeback();
+    void save_state( FILE *fp ) const;
+    void load_state( FILE *fp );
 
     // accessors
     virtual unsigned clock_multiplier() const;
@@ -1121,8 +1124,17 @@ public:
     void get_L1T_sub_stats(struct cache_sub_stats &css) const;
 
     void hist_cycle(){
-        m_L1D->hist_cycle();
+        if( m_L1D ) m_L1D->hist_cycle();
+        m_L1C->hist_cycle();
+        m_L1T->hist_cycle();
     }
+    // texture lines are read-only within a kernel and are never invalidated
+    bool hist_invalidate( new_addr_type addr ){
+        bool inv_d = m_L1D && m_L1D->invalidate( addr );
+        bool inv_c = m_L1C->invalidate( addr );
+        return inv_d || inv_c;
+    }
+    bool hist_holds( new_addr_type addr, int except_type = -1 ) const;
 protected:
     ldst_unit( mem_fetch_interface *icnt,
                shader_core_mem_fetch_allocator *mf_allocator,
@@ -1170,13 +1182,19 @@ protected:
    tex_cache *m_L1T; // texture cache
    read_only_cache *m_L1C; // constant cache
    l1_cache *m_L1D; // data cache
+   l1d_bypass_predictor *m_bypass_pred; // loads predicted to see no L1D reuse, NULL if off
+   unsigned m_bypass_uid;  // instruction the predictor last decided for
+   bool m_bypass_inst;     // and its decision, kept across retries
+   l1d_victim_cache *m_victim; // lines evicted from L1D, NULL if off
+   cache_prefetcher *m_prefetcher; // L1D prefetcher, NULL if off
    std::map<unsigned/*warp_id*/, std::map<unsigned/*regnum*/,unsigned/*count*/> > m_pending_writes;
    std::list<mem_fetch*> m_response_fifo;
    opndcoll_rfu_t *m_operand_collector;
    Scoreboard *m_scoreboard;
 
    mem_fetch *m_next_global;
-   warp_inst_t m_next_wb;
+   warp_inst_t m_next_wb;          // shared memory results, copied out of the pipeline
+   inflight_inst_ref m_next_wb_ref; // memory responses, written back from their shared record
    unsigned m_writeback_arb; // round-robin arbiter for writeback contention between L1T, L1C, shared
    unsigned m_num_writeback_clients;
 
@@ -1287,6 +1305,14 @@ struct shader_core_config : public core_config
     mutable l1d_cache_config m_L1D_config;
 
     bool gmem_skip_L1D; // on = global memory access always skip the L1 cache 
+    unsigned gpgpu_l1d_bypass_pred;            // PC-indexed bypass predictor entries, 0 = off
+    unsigned gpgpu_l1d_bypass_pred_threshold;
+    unsigned gpgpu_l1d_bypass_pred_sample;
+    unsigned gpgpu_l1d_victim_entries;          // L1D victim cache lines, 0 = off
+    unsigned gpgpu_l1d_victim_ports;
+    char *gpgpu_l1d_prefetcher;                 // none, stride or stream
+    unsigned gpgpu_l1d_prefetch_degree;
+    unsigned gpgpu_l1d_prefetch_table;          // stride prefetcher PCs
     
     bool gpgpu_dwf_reg_bankconflict;
 
@@ -1410,6 +1436,8 @@ struct shader_core_stats_pod {
     unsigned *gpgpu_n_shmem_bank_access;
     long *n_simt_to_mem; // Interconnect power stats
     long *n_mem_to_simt;
+    long *n_simt_to_hist; // HIST flits between SMs, not on the L1-L2 interconnect
+    long *n_hist_to_simt;
 };
 
 class shader_core_stats : public shader_core_stats_pod {
@@ -1461,6 +1489,8 @@ public:
 
         n_simt_to_mem = (long *)calloc(config->num_shader(), sizeof(long));
         n_mem_to_simt = (long *)calloc(config->num_shader(), sizeof(long));
+        n_simt_to_hist = (long *)calloc(config->num_shader(), sizeof(long));
+        n_hist_to_simt = (long *)calloc(config->num_shader(), sizeof(long));
 
         m_outgoing_traffic_stats = new traffic_breakdown("coretomem"); 
         m_incoming_traffic_stats = new traffic_breakdown("memtocore"); 
@@ -1480,6 +1510,8 @@ public:
         free(m_n_diverge); 
         free(shader_cycle_distro);
         free(last_shader_cycle_distro);
+        free(n_simt_to_hist);
+        free(n_hist_to_simt);
     }
 
     void new_grid()
@@ -1546,14 +1578,17 @@ public:
     
     mem_fetch *alloc( const warp_inst_t &inst, const mem_access_t &access ) const
     {
-        warp_inst_t inst_copy = inst;
+        // all accesses of one warp instruction share one in-flight record
+        if( m_inst_ref.empty() || m_inst_ref.get().get_uid() != inst.get_uid() ) 
+            m_inst_ref = inflight_inst_ref( inst );
         mem_fetch *mf = new mem_fetch(access, 
-                                      &inst_copy, 
+                                      NULL, 
                                       access.is_write()?WRITE_PACKET_SIZE:READ_PACKET_SIZE,
                                       inst.warp_id(),
                                       m_core_id, 
                                       m_cluster_id, 
                                       m_memory_config);
+        mf->set_inst( m_inst_ref );
         return mf;
     }
 
@@ -1561,6 +1596,7 @@ private:
     unsigned m_core_id;
     unsigned m_cluster_id;
     const memory_config *m_memory_config;
+    mutable inflight_inst_ref m_inst_ref; // record of the last instruction seen
 };
 
 class shader_core_ctx : public core_t {
@@ -1580,9 +1616,17 @@ public:
     void hist_cycle(){
         m_ldst_unit->hist_cycle();
     }
+    bool hist_invalidate( new_addr_type addr ){
+        return m_ldst_unit->hist_invalidate( addr );
+    }
+    bool hist_holds( new_addr_type addr, int except_type = -1 ) const {
+        return m_ldst_unit->hist_holds( addr, except_type );
+    }
     void reinit(unsigned start_thread, unsigned end_thread, bool reset_not_completed );
     void issue_block2core( class kernel_info_t &kernel );
     void cache_flush();
+    void save_state( FILE *fp ) const { m_L1I->save_state(fp); m_ldst_unit->save_state(fp); }
+    void load_state( FILE *fp ) { m_L1I->load_state(fp); m_ldst_unit->load_state(fp); }
     void accept_fetch_response( mem_fetch *mf );
     void accept_ldst_unit_response( class mem_fetch * mf );
     void broadcast_barrier_reduction(unsigned cta_id, unsigned bar_id,warp_set_t warps);
@@ -1856,6 +1900,8 @@ public:
     void reinit();
     unsigned issue_block2core();
     void cache_flush();
+    void save_state( FILE *fp ) const;
+    void load_state( FILE *fp );
     bool icnt_injection_buffer_full(unsigned size, bool write);
     void icnt_inject_request_packet(class mem_fetch *mf);
 
@@ -1866,6 +1912,18 @@ public:
     void push_response_fifo(class mem_fetch *mf) {
         m_response_fifo.push_back(mf);
     }
+    // HIST ejection port, arbitrates with ICNT replies for m_response_fifo
+    bool hist_response_full() const {
+        return ( m_hist_eject_size > 0 && m_hist_response_fifo.size() >= m_hist_eject_size );
+    }
+    void push_hist_response( class mem_fetch *mf );
+    void hist_eject( unsigned reserve );
+    bool hist_invalidate( unsigned sid, new_addr_type addr ) {
+        return m_core[m_config->sid_to_cid(sid)]->hist_invalidate( addr );
+    }
+    bool hist_holds( unsigned sid, new_addr_type addr, int except_type = -1 ) const {
+        return m_core[m_config->sid_to_cid(sid)]->hist_holds( addr, except_type );
+    }
 
     void get_pdom_stack_top_info( unsigned sid, unsigned tid, unsigned *pc, unsigned *rpc ) const;
     unsigned max_cta( const kernel_info_t &kernel );
@@ -1897,6 +1955,11 @@ private:
     unsigned m_cta_issue_next_core;
     std::list<unsigned> m_core_sim_order;
     std::list<mem_fetch*> m_response_fifo;
+
+    std::list<mem_fetch*> m_hist_response_fifo;
+    unsigned m_hist_eject_size;
+    unsigned m_hist_eject_width;
+    bool m_hist_eject_prio;
 };
 
 class shader_memory_interface : public mem_fetch_interface {